@@ -0,0 +1,514 @@
+/*
+ * Extensions to osu_bibw_modified: option handling, telemetry and the
+ * alternative measurement modes built around the bi-directional window
+ * exchange.
+ *
+ * Everything here sits on top of the OMB utility layer (osu_util_mpi.h) and
+ * follows its conventions: MPI errors abort through MPI_CHECK, option
+ * parsing reports through the PO_* codes and only rank 0 prints.
+ */
+#ifndef BIBW_H
+#define BIBW_H
+
+#include <osu_util_mpi.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Extension options. The stock OMB parser rejects flags it does not know,
+ * so bibw_process_options() consumes these long options and removes them
+ * from argv before process_options() sees the command line.
+ */
+#define BIBW_HOST_LEN 64
+
+#define BIBW_MAX_ENGINES 8
+
+#define BIBW_PATH_LEN 256
+
+#define BIBW_MAX_BIND 64
+
+#define BIBW_MAX_LOAD_LEVELS 16
+
+#define BIBW_LOAD_UNTHROTTLED (-1.0)
+
+enum bibw_pairing {
+    BIBW_PAIR_BLOCK,
+    BIBW_PAIR_CYCLIC,
+    BIBW_PAIR_CROSS_NODE,
+};
+
+enum bibw_arena_kind {
+    BIBW_ARENA_OFF,
+    BIBW_ARENA_PAGES,
+    BIBW_ARENA_HUGE,
+};
+
+enum bibw_kernel {
+    BIBW_KERNEL_TRIAD,
+    BIBW_KERNEL_MATVEC,
+};
+
+enum bibw_membind {
+    BIBW_MEMBIND_OFF,
+    BIBW_MEMBIND_LOCAL,
+    BIBW_MEMBIND_REMOTE,
+    BIBW_MEMBIND_NODES,
+};
+
+enum bibw_validator {
+    BIBW_VALIDATOR_OMB,
+    BIBW_VALIDATOR_COMPARE,
+    BIBW_VALIDATOR_CRC32C,
+};
+
+enum bibw_ddt_layout {
+    BIBW_DDT_VECTOR,
+    BIBW_DDT_INDEXED,
+};
+
+enum bibw_stream_completion {
+    BIBW_STREAM_WAITSOME,
+    BIBW_STREAM_TESTSOME,
+};
+
+enum bibw_load {
+    BIBW_LOAD_BULK,
+    BIBW_LOAD_FLOOD,
+    BIBW_LOAD_ALLTOALL,
+};
+
+enum bibw_load_source {
+    BIBW_LOAD_RANKS,
+    BIBW_LOAD_THREAD,
+};
+
+enum bibw_output_format {
+    BIBW_OUTPUT_TEXT,
+    BIBW_OUTPUT_JSON,
+    BIBW_OUTPUT_CSV,
+};
+
+struct bibw_mode_t;
+struct bibw_engine_t;
+
+struct bibw_options_t {
+    int statsd;                       /* ship telemetry to StatsD */
+    char statsd_host[BIBW_HOST_LEN];  /* StatsD host name or address */
+    int statsd_port;                  /* StatsD UDP port */
+    int statsd_mtu;                   /* link MTU used to size datagrams */
+    int rounds;                       /* on/off rounds in comparison modes */
+    int num_engines;
+    const struct bibw_engine_t *engines[BIBW_MAX_ENGINES];
+    int partitions;                   /* partitions per partitioned message */
+    int arena;                        /* BIBW_ARENA_* */
+    int pairing;                      /* BIBW_PAIR_* */
+    int threads;                      /* max threads per rank, 0 = cores */
+    int thread_full_window;           /* each thread posts a full window */
+    double sweep_threshold;           /* bandwidth drop that marks a cliff */
+    int sweep_resolution;             /* bytes; stop bisecting below this */
+    int tune_max_window;              /* deepest window the tuner tries */
+    int tune_memory;                  /* MB of -b multiple buffers it may use */
+    double tune_budget;               /* seconds of search per size */
+    double tune_flat;                 /* % below peak that counts as flat */
+    double ci_target;                 /* relative CI half-width to reach, % */
+    double ci_max_time;               /* seconds per size before giving up */
+    int ci_batch;                     /* windows per convergence batch */
+    int output;                       /* BIBW_OUTPUT_* */
+    char output_file[BIBW_PATH_LEN];  /* empty: derived from the format */
+    int phases;                       /* time the phases of each window */
+    int overlap_kernel;               /* BIBW_KERNEL_* */
+    double overlap_compute;           /* kernel time, % of the comm time */
+    int overlap_poke;                 /* kernel blocks per MPI_Test, 0 = off */
+    int shm_nt;                       /* bytes from which copies stream */
+    int num_bind_cpus;
+    int bind_cpus[BIBW_MAX_BIND];     /* rank r runs on bind_cpus[r % n] */
+    int membind;                      /* BIBW_MEMBIND_* */
+    int num_mem_nodes;
+    int mem_nodes[BIBW_MAX_BIND];     /* BIBW_MEMBIND_NODES, like bind_cpus */
+    int validator;                    /* BIBW_VALIDATOR_* used by -c */
+    int validate_every;               /* check every Nth timed window */
+    int validate_slices;              /* 4 KiB slices per buffer, 0 = all */
+    int ddt_layout;                   /* BIBW_DDT_* */
+    int ddt_block;                    /* doubles per block */
+    int ddt_stride;                   /* doubles from block to block */
+    int ddt_chunks;                   /* pipeline chunks per message */
+    int stream_bytes;                 /* bytes per direction and size */
+    int stream_depth;                 /* messages in flight, 0 = -W */
+    int stream_completion;            /* BIBW_STREAM_* */
+    int load;                         /* BIBW_LOAD_BULK/FLOOD/ALLTOALL */
+    int load_source;                  /* BIBW_LOAD_RANKS/THREAD */
+    int load_size;                    /* background bytes, 0 = per shape */
+    int num_load_rates;
+    double load_rates[BIBW_MAX_LOAD_LEVELS]; /* MB/s per generator */
+    const struct bibw_mode_t *mode;   /* NULL runs the regular sweep */
+};
+
+extern struct bibw_options_t bibw_options;
+
+int bibw_process_options(int *argc, char *argv[]);
+void bibw_print_help_message(int rank);
+
+/*
+ * Alternative measurement modes selected with --mode=NAME. A mode replaces
+ * the regular size sweep in main() and returns the number of errors seen.
+ * Modes with any_procs set check the process count themselves; all others
+ * keep the stock two-process requirement. thread_level is the MPI thread
+ * support the mode drives MPI with. Modes without results set write
+ * nothing through bibw_output_result()/bibw_output_call(), so --output is
+ * refused for them.
+ */
+struct bibw_mode_t {
+    const char *name;
+    const char *help;
+    int (*run)(MPI_Comm comm, int rank, int numprocs);
+    int any_procs;
+    int thread_level;
+    int results;
+};
+
+omb_mpi_init_data bibw_mpi_init(int *argc, char ***argv);
+
+int bibw_mode_telemetry_overhead(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_pairs(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_threads(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_sweep(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_tune(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_converge(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_calls(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_overlap(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_shm(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_placement(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_ddt(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_stream(MPI_Comm comm, int rank, int numprocs);
+int bibw_mode_contention(MPI_Comm comm, int rank, int numprocs);
+
+/*
+ * Rank pairing for multi-pair modes. partner[r] is r's peer and
+ * pair_index[r] the pair r belongs to, numbered so that the first n pairs
+ * are the ones used when measuring with n pairs.
+ */
+struct bibw_pairs_t {
+    int npairs;
+    int cross_node;                   /* pairs whose ranks sit on two nodes */
+    int *partner;
+    int *pair_index;
+};
+
+int bibw_pairs_init(struct bibw_pairs_t *p, MPI_Comm comm, int pairing);
+void bibw_pairs_free(struct bibw_pairs_t *p);
+const char *bibw_pairing_name(int pairing);
+
+/*
+ * Core and NUMA placement from --bind/--membind, applied right after
+ * MPI_Init and before any benchmark buffer is touched. The report is
+ * collective and prints what every rank actually got; buf is a touched
+ * buffer whose first page is located, or NULL.
+ */
+int bibw_placement_apply(int rank);
+void bibw_placement_report(MPI_Comm comm, int rank, int numprocs,
+                           const void *buf);
+
+/*
+ * Sampled validation for -c with --validator=compare|crc32c: seeded
+ * vector-generated patterns, checked between windows on every
+ * --validate-every'th timed window, whole buffers or --validate-slices
+ * random slices. bibw_validate_fast() is false (stock OMB validation) for
+ * derived datatypes and device buffers. bibw_validate_check() is called
+ * by both ranks at the same window since crc32c swaps checksums.
+ */
+struct bibw_validator_t {
+    long checked;                     /* windows checked this size */
+    size_t fill_bytes;
+    size_t check_bytes;
+    double fill_time;
+    double check_time;
+    uint32_t *crc;                    /* per buffer: own, then the peer's */
+};
+
+int bibw_validate_init(struct bibw_validator_t *v, int nbufs);
+int bibw_validate_fast(void);
+int bibw_validate_due(int i, int skip);
+void bibw_validate_fill(struct bibw_validator_t *v, char **s_buf, int nbufs,
+                        size_t size, int seed);
+int bibw_validate_check(struct bibw_validator_t *v, MPI_Comm comm, int peer,
+                        char **r_buf, int nbufs, size_t size, int seed);
+void bibw_validate_reset(struct bibw_validator_t *v);
+void bibw_validate_report(const struct bibw_validator_t *v, int windows);
+void bibw_validate_free(struct bibw_validator_t *v);
+
+/*
+ * Buffer arena for MULTIPLE buffers. One mapping holds nbufs send and nbufs
+ * receive slots of max_size bytes each (page rounded); every message size
+ * reuses the front of the same slots, so buffer j keeps the same address
+ * for the whole sweep. The mapping is pre-faulted once at creation and is
+ * never returned to the allocator, so registrations the MPI library caches
+ * for it stay valid across sizes.
+ */
+struct bibw_arena_t {
+    char *base;
+    size_t bytes;
+    size_t stride;
+    int nbufs;
+    int huge;
+};
+
+int bibw_arena_active(void);
+int bibw_arena_init(struct bibw_arena_t *a, size_t max_size, int nbufs,
+                    int rank);
+void bibw_arena_carve(const struct bibw_arena_t *a, char **s_buf,
+                      char **r_buf);
+void bibw_arena_warm(const struct bibw_arena_t *a, MPI_Comm comm, int peer);
+void bibw_arena_free(struct bibw_arena_t *a);
+
+/*
+ * One bi-directional window: window_size receives from and window_size
+ * sends to the peer, completed before the next window starts. The engine
+ * decides how the messages are posted; the isend engine is the exchange
+ * main() runs inline.
+ */
+struct bibw_window_t {
+    MPI_Comm comm;
+    int rank;
+    int peer;
+    int send_tag;
+    int recv_tag;
+    int window_size;                  /* messages per window in use */
+    int max_window;                   /* depth the window was set up for */
+    int nbufs;                        /* 1 for SINGLE, max_window otherwise */
+    int owns_buffers;
+    struct bibw_arena_t arena;        /* backs owned MULTIPLE buffers */
+    size_t size;                      /* bytes per message */
+    int count;                        /* elements of dtype per message */
+    MPI_Datatype dtype;
+    char **s_buf;
+    char **r_buf;
+    MPI_Request *send_request;
+    MPI_Request *recv_request;
+    const struct bibw_engine_t *engine;
+    int prepared;                     /* engine holds requests for size */
+    int partitions;                   /* partitions in use by this size */
+    MPI_Win win;                      /* RMA engines: the peer's target */
+    size_t win_slot;                  /* bytes per message slot in win */
+};
+
+/*
+ * A window engine. prepare() runs once per message size (after buffers and
+ * count are set) and may build persistent requests; exchange() runs one
+ * window; release() drops whatever prepare() built.
+ */
+struct bibw_engine_t {
+    const char *name;
+    int (*prepare)(struct bibw_window_t *w);
+    void (*exchange)(struct bibw_window_t *w);
+    void (*release)(struct bibw_window_t *w);
+};
+
+extern const struct bibw_engine_t bibw_engine_isend;
+const struct bibw_engine_t *bibw_engine_find(const char *name);
+void bibw_engine_list(FILE *out);
+
+int bibw_window_init(struct bibw_window_t *w, MPI_Comm comm, int rank,
+                     int peer, int window_size);
+int bibw_window_init_sized(struct bibw_window_t *w, MPI_Comm comm, int rank,
+                           int peer, int window_size, size_t max_size);
+int bibw_window_borrow(struct bibw_window_t *w, MPI_Comm comm, int rank,
+                       int peer, int window_size, char **s_buf, char **r_buf);
+void bibw_window_set_engine(struct bibw_window_t *w,
+                            const struct bibw_engine_t *engine);
+int bibw_window_set_size(struct bibw_window_t *w, size_t size);
+int bibw_window_set_type(struct bibw_window_t *w, size_t size, int count,
+                         MPI_Datatype dtype);
+int bibw_window_set_depth(struct bibw_window_t *w, int window_size);
+void bibw_window_exchange(struct bibw_window_t *w);
+void bibw_window_post(struct bibw_window_t *w);
+void bibw_window_wait(struct bibw_window_t *w);
+double bibw_window_time(struct bibw_window_t *w, int iterations, int skip);
+double bibw_window_run(struct bibw_window_t *w, int iterations, int skip);
+void bibw_window_free(struct bibw_window_t *w);
+
+/*
+ * StatsD telemetry. Records are pushed into a preallocated single-producer
+ * ring on the hot path; a background thread formats them into multi-metric
+ * datagrams and ships them with sendmmsg(). Emitting before init (or on
+ * ranks that never initialise it) is a no-op.
+ */
+#define BIBW_METRIC_NAME_LEN 64
+#define BIBW_METRIC_TAGS_LEN 96
+
+int bibw_telemetry_init(const char *host, int port, int mtu);
+int bibw_telemetry_enabled(void);
+void bibw_telemetry_emit(const char *name, double value, const char *type,
+                         const char *tags);
+void bibw_telemetry_flush(void);
+unsigned long bibw_telemetry_dropped(void);
+void bibw_telemetry_finalize(void);
+
+/*
+ * Log-linear (HDR-style) histogram of durations. Values are kept in
+ * nanoseconds; each power-of-two range is split into BIBW_HIST_SUB / 2
+ * linear sub-buckets, which bounds the relative error of any reported
+ * quantile to 2 / BIBW_HIST_SUB (about 1.6%) across the whole range.
+ * Recording is a count-leading-zeros and an increment.
+ */
+#define BIBW_HIST_SUB_BITS 7
+#define BIBW_HIST_SUB (1 << BIBW_HIST_SUB_BITS)
+#define BIBW_HIST_BUCKETS ((64 - BIBW_HIST_SUB_BITS + 2) * (BIBW_HIST_SUB / 2))
+
+struct bibw_hist_t {
+    uint64_t count;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    double sum;
+    uint64_t counts[BIBW_HIST_BUCKETS];
+};
+
+static inline int bibw_hist_bucket(uint64_t ns)
+{
+    int e = 0;
+
+    if (ns < BIBW_HIST_SUB) {
+        return (int)ns;
+    }
+    e = 63 - __builtin_clzll(ns) - (BIBW_HIST_SUB_BITS - 1);
+    return e * (BIBW_HIST_SUB / 2) + (int)(ns >> e);
+}
+
+static inline void bibw_hist_record(struct bibw_hist_t *h, double seconds)
+{
+    uint64_t ns = seconds > 0.0 ? (uint64_t)(seconds * 1e9) : 0;
+
+    h->counts[bibw_hist_bucket(ns)]++;
+    h->count++;
+    h->sum += seconds;
+    if (ns < h->min_ns) {
+        h->min_ns = ns;
+    }
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+}
+
+void bibw_hist_reset(struct bibw_hist_t *h);
+double bibw_hist_quantile(const struct bibw_hist_t *h, double q);
+void bibw_hist_emit(const struct bibw_hist_t *h, const char *name,
+                    const char *tags);
+
+/*
+ * Phase timers for the window exchange (--phases=on). Each timed window is
+ * split into posting the receives, posting the sends and the two waits,
+ * on both ranks. Timestamps come from the TSC when the CPU reports an
+ * invariant one, calibrated against CLOCK_MONOTONIC_RAW at start-up, and
+ * from clock_gettime() otherwise. The TSC is read without serialisation:
+ * phases last microseconds, far above the few cycles of reordering.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BIBW_HAVE_TSC 1
+#else
+#define BIBW_HAVE_TSC 0
+#endif
+#include <time.h>
+
+enum bibw_phase {
+    BIBW_PHASE_POST_RECV,
+    BIBW_PHASE_POST_SEND,
+    BIBW_PHASE_WAIT_SEND,
+    BIBW_PHASE_WAIT_RECV,
+    BIBW_NUM_PHASES,
+};
+
+extern int bibw_clock_tsc;            /* ticks are TSC cycles, not ns */
+
+static inline uint64_t bibw_ticks(void)
+{
+    struct timespec ts;
+
+#if BIBW_HAVE_TSC
+    if (bibw_clock_tsc) {
+        return __rdtsc();
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+struct bibw_phases_t {
+    uint64_t ticks[BIBW_NUM_PHASES];
+    uint64_t last;
+    long windows;
+    int on;                           /* the current window is timed */
+};
+
+/* Start a window; only windows with timed set are accumulated */
+static inline void bibw_phase_begin(struct bibw_phases_t *p, int timed)
+{
+    p->on = timed && bibw_options.phases;
+    if (p->on) {
+        p->windows++;
+        p->last = bibw_ticks();
+    }
+}
+
+/* Close phase and start the next one */
+static inline void bibw_phase_end(struct bibw_phases_t *p, int phase)
+{
+    uint64_t now = 0;
+
+    if (p->on) {
+        now = bibw_ticks();
+        p->ticks[phase] += now - p->last;
+        p->last = now;
+    }
+}
+
+void bibw_clock_init(void);
+const char *bibw_clock_name(void);
+void bibw_phases_reset(struct bibw_phases_t *p);
+void bibw_phases_report(const struct bibw_phases_t *p, MPI_Comm comm,
+                        int rank, int numprocs, size_t size);
+
+/*
+ * Structured results. With --output=json|csv rank 0 writes one record of
+ * run metadata followed by one record per measured (size, datatype,
+ * engine), next to the usual text table on stdout. bibw_output_open() is
+ * collective since it gathers the host names of all ranks.
+ */
+struct bibw_stats_t;
+
+struct bibw_result_t {
+    size_t size;
+    const char *datatype;
+    const char *engine;
+    int window;
+    int iterations;
+    double bandwidth;                 /* MB/s over all timed windows */
+    struct bibw_stats_t *windows;     /* per-window MB/s, or NULL */
+};
+
+int bibw_output_open(MPI_Comm comm, int rank, int numprocs);
+int bibw_output_enabled(void);
+void bibw_output_result(const struct bibw_result_t *r);
+void bibw_output_call(const char *call, struct bibw_stats_t *ns);
+void bibw_output_close(void);
+
+/*
+ * Sample accumulator: running mean and variance (Welford) plus the raw
+ * samples for order statistics.
+ */
+struct bibw_stats_t {
+    double *samples;
+    size_t n;
+    size_t cap;
+    double mean;
+    double m2;
+};
+
+void bibw_stats_reset(struct bibw_stats_t *st);
+void bibw_stats_add(struct bibw_stats_t *st, double x);
+double bibw_stats_stddev(const struct bibw_stats_t *st);
+double bibw_stats_ci95(const struct bibw_stats_t *st);
+double bibw_stats_median(struct bibw_stats_t *st);
+void bibw_stats_free(struct bibw_stats_t *st);
+
+#endif /* BIBW_H */
@@ -0,0 +1,125 @@
+/*
+ * Size-class buffer arena for the message-size sweep.
+ *
+ * With -b multiple the stock loop allocates, touches and frees window_size
+ * send and receive buffers at every size. Each round trip through the
+ * allocator costs page faults on first touch and, for large sizes, returns
+ * the pages to the kernel, which also invalidates whatever registrations
+ * the MPI library cached for them. The arena maps everything once.
+ */
+#define _GNU_SOURCE
+#include "bibw.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define BIBW_HUGE_PAGE (2UL * 1024 * 1024)
+#define BIBW_ARENA_WARM_TAG 1000
+
+static size_t round_up(size_t n, size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+/*
+ * The arena only replaces host allocations; device and managed buffers
+ * keep going through allocate_memory_pt2pt_size().
+ */
+int bibw_arena_active(void)
+{
+    return BIBW_ARENA_OFF != bibw_options.arena &&
+           options.buf_num == MULTIPLE && NONE == options.accel;
+}
+
+int bibw_arena_init(struct bibw_arena_t *a, size_t max_size, int nbufs,
+                    int rank)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *base = MAP_FAILED;
+
+    memset(a, 0, sizeof(*a));
+    a->nbufs = nbufs;
+    a->stride = round_up(max_size > 0 ? max_size : 1, page);
+    a->bytes = a->stride * nbufs * 2;
+
+    if (BIBW_ARENA_HUGE == bibw_options.arena) {
+#ifdef MAP_HUGETLB
+        a->bytes = round_up(a->bytes, BIBW_HUGE_PAGE);
+        base = mmap(NULL, a->bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (MAP_FAILED == base && 0 == rank) {
+            fprintf(stderr, "Warning: no 2 MB hugepages reserved, using "
+                            "transparent hugepages where available\n");
+        }
+        a->huge = MAP_FAILED != base;
+    }
+    if (MAP_FAILED == base) {
+        base = mmap(NULL, a->bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == base) {
+            return -1;
+        }
+#ifdef MADV_HUGEPAGE
+        if (BIBW_ARENA_HUGE == bibw_options.arena) {
+            madvise(base, a->bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    a->base = base;
+
+    /* Fault every page in now, with the data set_buffer_pt2pt() would use */
+    memset(a->base, 'a', a->stride * nbufs);
+    memset(a->base + a->stride * nbufs, 'b', a->stride * nbufs);
+
+    return 0;
+}
+
+/* Point s_buf[j]/r_buf[j] at slot j; valid for any size up to max_size */
+void bibw_arena_carve(const struct bibw_arena_t *a, char **s_buf,
+                      char **r_buf)
+{
+    int j = 0;
+
+    for (j = 0; j < a->nbufs; j++) {
+        s_buf[j] = a->base + a->stride * j;
+        r_buf[j] = a->base + a->stride * (a->nbufs + j);
+    }
+}
+
+/*
+ * Move every slot once at full size so transports that register memory on
+ * first use do it here instead of inside the first timed windows.
+ */
+void bibw_arena_warm(const struct bibw_arena_t *a, MPI_Comm comm, int peer)
+{
+    MPI_Request reqs[2];
+    size_t off = 0, chunk = 0;
+    int j = 0;
+
+    for (j = 0; j < a->nbufs; j++) {
+        /* Counts are int; walk slots larger than 1 GB in pieces */
+        for (off = 0; off < a->stride; off += chunk) {
+            chunk = a->stride - off < (1UL << 30) ? a->stride - off
+                                                  : (1UL << 30);
+            MPI_CHECK(MPI_Irecv(a->base + a->stride * (a->nbufs + j) + off,
+                                (int)chunk, MPI_CHAR, peer, BIBW_ARENA_WARM_TAG,
+                                comm, &reqs[0]));
+            MPI_CHECK(MPI_Isend(a->base + a->stride * j + off, (int)chunk,
+                                MPI_CHAR, peer, BIBW_ARENA_WARM_TAG, comm,
+                                &reqs[1]));
+            MPI_CHECK(MPI_Waitall(2, reqs, MPI_STATUSES_IGNORE));
+        }
+    }
+    /* Restore the receive pattern the warm-up overwrote; no faults now */
+    memset(a->base + a->stride * a->nbufs, 'b', a->stride * a->nbufs);
+}
+
+void bibw_arena_free(struct bibw_arena_t *a)
+{
+    if (NULL != a->base) {
+        munmap(a->base, a->bytes);
+    }
+    memset(a, 0, sizeof(*a));
+}
@@ -0,0 +1,102 @@
+/*
+ * --mode=calls
+ *
+ * Cost of the calls the window exchange is built from, with no data to
+ * move. Every window posts window_size zero-byte MPI_Irecv and MPI_Isend
+ * to the peer (same tags and order as the stock exchange), completes them
+ * with the two MPI_Waitall, then calls MPI_Waitall once more over a
+ * window of MPI_REQUEST_NULL. The posting loops and the null wait are
+ * timed separately and reported per call.
+ *
+ * osu_bibw_matched.py runs the same schedule through mpi4py, so the
+ * difference between the two tables is what the binding adds per call;
+ * bibw_compare.py --decompose uses it to split the bandwidth gap between
+ * per-call overhead and data movement.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+enum { CALL_IRECV, CALL_ISEND, CALL_WAITALL, NUM_CALLS };
+
+static const char *const call_names[NUM_CALLS] = {
+    "MPI_Irecv",
+    "MPI_Isend",
+    "MPI_Waitall",
+};
+
+int bibw_mode_calls(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_stats_t st[NUM_CALLS];
+    MPI_Request *send_request = NULL, *recv_request = NULL, *nulls = NULL;
+    int window = options.window_size, peer = 1 - rank;
+    int iterations = options.iterations, skip = options.skip;
+    int send_tag = rank < peer ? 100 : 10, recv_tag = rank < peer ? 10 : 100;
+    double t[5];
+    char byte = 0;
+    int i = 0, j = 0, c = 0;
+
+    (void)numprocs;
+    send_request = malloc(sizeof(MPI_Request) * window);
+    recv_request = malloc(sizeof(MPI_Request) * window);
+    nulls = malloc(sizeof(MPI_Request) * window);
+    if (NULL == send_request || NULL == recv_request || NULL == nulls) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+    for (c = 0; c < NUM_CALLS; c++) {
+        st[c] = (struct bibw_stats_t){0};
+    }
+
+    MPI_CHECK(MPI_Barrier(comm));
+    for (i = 0; i < iterations + skip; i++) {
+        t[0] = MPI_Wtime();
+        for (j = 0; j < window; j++) {
+            MPI_CHECK(MPI_Irecv(&byte, 0, MPI_CHAR, peer, recv_tag, comm,
+                                recv_request + j));
+        }
+        t[1] = MPI_Wtime();
+        for (j = 0; j < window; j++) {
+            MPI_CHECK(MPI_Isend(&byte, 0, MPI_CHAR, peer, send_tag, comm,
+                                send_request + j));
+        }
+        t[2] = MPI_Wtime();
+        MPI_CHECK(MPI_Waitall(window, send_request, MPI_STATUSES_IGNORE));
+        MPI_CHECK(MPI_Waitall(window, recv_request, MPI_STATUSES_IGNORE));
+        for (j = 0; j < window; j++) {
+            nulls[j] = MPI_REQUEST_NULL;
+        }
+        t[3] = MPI_Wtime();
+        MPI_CHECK(MPI_Waitall(window, nulls, MPI_STATUSES_IGNORE));
+        t[4] = MPI_Wtime();
+        if (i >= skip) {
+            bibw_stats_add(&st[CALL_IRECV], (t[1] - t[0]) * 1e9 / window);
+            bibw_stats_add(&st[CALL_ISEND], (t[2] - t[1]) * 1e9 / window);
+            bibw_stats_add(&st[CALL_WAITALL], (t[4] - t[3]) * 1e9);
+        }
+    }
+
+    if (0 == rank) {
+        fprintf(stdout, "# Null-call cost: %d zero-byte messages per window "
+                        "and direction, %zu windows\n",
+                window, options.iterations);
+        fprintf(stdout, "%-14s%*s%*s%*s\n", "# Call", FIELD_WIDTH,
+                "Mean (ns)", FIELD_WIDTH, "Median (ns)", FIELD_WIDTH,
+                "Stddev (ns)");
+        for (c = 0; c < NUM_CALLS; c++) {
+            fprintf(stdout, "%-14s%*.*f%*.*f%*.*f\n", call_names[c],
+                    FIELD_WIDTH, FLOAT_PRECISION, st[c].mean, FIELD_WIDTH,
+                    FLOAT_PRECISION, bibw_stats_median(&st[c]), FIELD_WIDTH,
+                    FLOAT_PRECISION, bibw_stats_stddev(&st[c]));
+            bibw_output_call(call_names[c], &st[c]);
+        }
+        fflush(stdout);
+    }
+
+    for (c = 0; c < NUM_CALLS; c++) {
+        bibw_stats_free(&st[c]);
+    }
+    free(send_request);
+    free(recv_request);
+    free(nulls);
+    return 0;
+}
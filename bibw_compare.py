@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""Compare two osu_bibw result files and flag per-size regressions.
+
+Reads the JSON Lines and CSV files written by osu_bibw_modified
+--output=json|csv, and the plain text tables printed by osu_bibw,
+osu_bibw_modified and osu_bibw.py (results_c.txt, results_python.txt).
+
+Results are matched on (size, datatype, engine). A result counts as a
+regression when the candidate is more than --threshold percent slower than
+the baseline and, where both sides carry samples, the drop is significant
+under Welch's t-test at the 95% level. Samples are the per-window
+bandwidths recorded by the structured output, or the repeated rows when a
+file holds several runs of the same configuration; plain text tables of a
+single run have none, so there only the threshold applies. Text tables
+from validated (-c) runs are read too: rows that failed validation are
+left out and counted in the report.
+
+Exit status is 1 when any regression is found, so the script can gate an
+MPI library or container image upgrade:
+
+    mpirun -np 2 ./osu_bibw --output=json --output-file=new.jsonl
+    ./bibw_compare.py baseline.jsonl new.jsonl
+
+With --decompose the two files are two implementations of the same run
+(osu_bibw_modified and osu_bibw_matched.py, see bibw_matched.sh), each
+holding its --mode=calls records next to the sweep. For every isend size
+the extra time per window of the candidate is split into what its slower
+MPI_Irecv, MPI_Isend and MPI_Waitall calls account for (window_size of
+each posting call, two waits) and the remainder, data movement.
+"""
+
+import argparse
+import csv
+import io
+import json
+import math
+import re
+import sys
+
+# Two-sided 95% Student t quantiles for 1..30 degrees of freedom, the same
+# table bibw_stats.c uses
+T975 = [
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+]
+
+DEFAULT_DATATYPE = "MPI_CHAR"
+DEFAULT_ENGINE = "isend"
+VALIDATION_STATUS = ("Pass", "Fail")
+
+
+class Result:
+    """Bandwidth of one (size, datatype, engine) with optional spread.
+
+    bandwidth is the reported figure the change is computed from; mean,
+    stddev and n describe the samples behind it and feed the t-test.
+    """
+
+    def __init__(self, bandwidth, n=0, mean=None, stddev=None):
+        self.bandwidth = bandwidth
+        self.n = n
+        self.mean = bandwidth if mean is None else mean
+        self.stddev = stddev
+
+
+def t975(df):
+    if df < 1:
+        return math.inf
+    if df <= len(T975):
+        return T975[int(df) - 1]
+    return 1.960
+
+
+def merge(rows):
+    """Collapse repeated rows; more than one run gives run-level samples."""
+    if len(rows) == 1:
+        return rows[0]
+    values = [r.bandwidth for r in rows]
+    mean = sum(values) / len(values)
+    var = sum((v - mean) ** 2 for v in values) / (len(values) - 1)
+    return Result(mean, len(values), mean, math.sqrt(var))
+
+
+def load_json(text):
+    meta, rows, calls = {}, {}, {}
+    for line in text.splitlines():
+        if not line.strip():
+            continue
+        rec = json.loads(line)
+        if rec.get("type") == "run":
+            meta.update(rec)
+            continue
+        if rec.get("type") == "call":
+            calls[rec["call"]] = rec["mean_ns"]
+            continue
+        key = (rec["size"], rec.get("datatype", DEFAULT_DATATYPE),
+               rec.get("engine", DEFAULT_ENGINE))
+        rows.setdefault(key, []).append(
+            Result(rec["bandwidth_mbs"], rec.get("samples") or 0,
+                   rec.get("mean_mbs"), rec.get("stddev_mbs")))
+    meta["calls"] = calls
+    return meta, rows
+
+
+def load_csv(text):
+    meta, body, calls = {}, [], {}
+    for line in text.splitlines():
+        m = re.match(r"#\s*call\.(\S+)_ns:\s*(\S+)", line)
+        if m:
+            calls[m.group(1)] = float(m.group(2))
+        elif line.startswith("#"):
+            key, _, value = line[1:].partition(":")
+            meta[key.strip()] = value.strip()
+        elif line.strip():
+            body.append(line)
+    rows = {}
+    for rec in csv.DictReader(io.StringIO("\n".join(body))):
+        def num(name):
+            return float(rec[name]) if rec.get(name) else None
+        key = (int(rec["size"]), rec["datatype"], rec["engine"])
+        rows.setdefault(key, []).append(
+            Result(float(rec["bandwidth_mbs"]), int(rec["samples"] or 0),
+                   num("mean_mbs"), num("stddev_mbs")))
+    meta["calls"] = calls
+    return meta, rows
+
+
+def load_text(text, section):
+    """Parse the fixed-width tables; "# ... Test" lines start a section."""
+    sections, failed, title = {}, {}, ""
+    datatype, engines = DEFAULT_DATATYPE, []
+    for line in text.splitlines():
+        stripped = line.strip()
+        if stripped.startswith("#"):
+            m = re.match(r"#\s*Datatype:\s*(\S+?)\.?$", stripped)
+            if m:
+                datatype = m.group(1)
+            elif stripped.startswith("# Trailing columns:"):
+                engines = re.findall(r"(\S+) \(MB/s\)", stripped)
+            elif "Test" in stripped:
+                title, datatype, engines = stripped.lstrip("# "), \
+                    DEFAULT_DATATYPE, []
+            continue
+        fields = stripped.split()
+        if len(fields) < 2 or not fields[0].isdigit():
+            continue
+        # -c runs print Pass/Fail after the bandwidth; failed rows are
+        # counted and left out, the column itself is dropped
+        status = [f for f in fields[1:] if f in VALIDATION_STATUS]
+        if "Fail" in status:
+            failed[title] = failed.get(title, 0) + 1
+            continue
+        try:
+            values = [float(f) for f in fields[1:]
+                      if f not in VALIDATION_STATUS]
+        except ValueError:
+            continue
+        rows = sections.setdefault(title, {})
+        size = int(fields[0])
+        rows.setdefault((size, datatype, DEFAULT_ENGINE), []).append(
+            Result(values[0]))
+        # Engine columns trail everything else on the row
+        for name, value in zip(engines, values[len(values) - len(engines):]):
+            rows.setdefault((size, datatype, name), []).append(Result(value))
+
+    if section is None:
+        section = "Bi-Directional"
+    picked = [t for t in sections if section in t]
+    if not picked:
+        picked = list(sections)[:1]
+    rows = sections[picked[0]] if picked else {}
+    meta = {"benchmark": picked[0] if picked else ""}
+    if picked and failed.get(picked[0]):
+        meta["failed_validation"] = failed[picked[0]]
+    return meta, rows
+
+
+def load(path, section):
+    with open(path) as f:
+        text = f.read()
+    first = text.lstrip()[:1]
+    if first == "{":
+        meta, rows = load_json(text)
+    elif re.search(r"^size,datatype,engine", text, re.M):
+        meta, rows = load_csv(text)
+    else:
+        meta, rows = load_text(text, section)
+    return meta, {k: merge(v) for k, v in rows.items()}
+
+
+def welch(a, b):
+    """t statistic and degrees of freedom, or None without spread."""
+    if a.n < 2 or b.n < 2 or a.stddev is None or b.stddev is None:
+        return None
+    va, vb = a.stddev ** 2 / a.n, b.stddev ** 2 / b.n
+    if va + vb == 0.0:
+        return None
+    t = (b.mean - a.mean) / math.sqrt(va + vb)
+    df = (va + vb) ** 2 / (va ** 2 / (a.n - 1) + vb ** 2 / (b.n - 1))
+    return t, df
+
+
+def compare(base, cand, threshold):
+    """Yield (key, base, cand, change %, verdict) for every shared key."""
+    for key in sorted(set(base) & set(cand)):
+        a, b = base[key], cand[key]
+        change = ((b.bandwidth - a.bandwidth) / a.bandwidth * 100.0
+                  if a.bandwidth else 0.0)
+        test = welch(a, b)
+        significant = test is None or (abs(test[0]) > t975(test[1]) and
+                                       (test[0] < 0) == (change < 0))
+        if change < -threshold and significant:
+            verdict = "REGRESSION"
+        elif change > threshold and significant:
+            verdict = "improved"
+        elif abs(change) > threshold:
+            verdict = "noise"
+        else:
+            verdict = ""
+        if verdict and test is None:
+            verdict += " (no samples)"
+        yield key, a, b, change, verdict
+
+
+def decompose(base_meta, base, cand_meta, cand):
+    """Split the per-window time gap into call overhead and the rest."""
+    calls = ("MPI_Irecv", "MPI_Isend", "MPI_Waitall")
+    a_calls, b_calls = base_meta.get("calls", {}), cand_meta.get("calls", {})
+    missing = [c for c in calls if c not in a_calls or c not in b_calls]
+    if missing:
+        sys.exit("--decompose needs --mode=calls records in both files "
+                 "(missing %s)" % ", ".join(missing))
+    window = int(base_meta.get("window", 64))
+    if int(cand_meta.get("window", window)) != window:
+        sys.exit("--decompose needs the same window on both sides")
+
+    delta = {c: b_calls[c] - a_calls[c] for c in calls}
+    for c in calls:
+        print("# %-12s %10.1f ns -> %10.1f ns per call (%+.1f ns)" % (
+            c, a_calls[c], b_calls[c], delta[c]))
+    call_us = (window * (delta["MPI_Irecv"] + delta["MPI_Isend"]) +
+               2 * delta["MPI_Waitall"]) / 1e3
+    print("%-10s%16s%16s%16s%16s%16s%12s" % (
+        "# Size", "Base (MB/s)", "New (MB/s)", "Gap (us/win)",
+        "Calls (us/win)", "Data (us/win)", "Calls (%)"))
+    for key in sorted(set(base) & set(cand)):
+        if key[2] != DEFAULT_ENGINE:
+            continue
+        a, b = base[key], cand[key]
+        mb = key[0] * window * 2 / 1e6
+        gap_us = (mb / b.bandwidth - mb / a.bandwidth) * 1e6
+        share = call_us / gap_us * 100.0 if gap_us > 0 else math.nan
+        print("%-10d%16.2f%16.2f%16.2f%16.2f%16.2f%12.1f" % (
+            key[0], a.bandwidth, b.bandwidth, gap_us, call_us,
+            gap_us - call_us, share))
+
+
+def describe(meta):
+    keys = ("implementation", "mpi_library", "hosts", "window",
+            "iterations", "mode", "timestamp", "benchmark")
+    parts = []
+    for k in keys:
+        if k in meta:
+            v = meta[k]
+            parts.append("%s=%s" % (k, ",".join(v) if isinstance(v, list)
+                                    else v))
+    return " ".join(parts) if parts else "(no metadata)"
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Flag per-size bandwidth regressions between two "
+                    "osu_bibw result files.")
+    parser.add_argument("--decompose", action="store_true",
+                        help="split the gap into per-call overhead and data "
+                             "movement instead of flagging regressions")
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="slowdown in percent below which nothing is "
+                             "flagged (default 5)")
+    parser.add_argument("--section",
+                        help="text files only: pick the table whose title "
+                             "contains this (default Bi-Directional)")
+    args = parser.parse_args()
+
+    base_meta, base = load(args.baseline, args.section)
+    cand_meta, cand = load(args.candidate, args.section)
+    print("# Baseline:  %s: %s" % (args.baseline, describe(base_meta)))
+    print("# Candidate: %s: %s" % (args.candidate, describe(cand_meta)))
+    for name, meta in (("baseline", base_meta), ("candidate", cand_meta)):
+        if meta.get("failed_validation"):
+            print("# %d rows of the %s failed validation and are left out" %
+                  (meta["failed_validation"], name))
+    for name, only in (("baseline", set(base) - set(cand)),
+                       ("candidate", set(cand) - set(base))):
+        if only:
+            print("# %d results only in the %s" % (len(only), name))
+    if args.decompose:
+        decompose(base_meta, base, cand_meta, cand)
+        return 0
+
+    print("%-10s%-14s%-12s%16s%16s%12s  %s" % (
+        "# Size", "Datatype", "Engine", "Base (MB/s)", "New (MB/s)",
+        "Change (%)", "Verdict"))
+    regressions = 0
+    for key, a, b, change, verdict in compare(base, cand, args.threshold):
+        print("%-10d%-14s%-12s%16.2f%16.2f%12.2f  %s" % (
+            key[0], key[1], key[2], a.bandwidth, b.bandwidth, change,
+            verdict))
+        regressions += verdict.startswith("REGRESSION")
+    print("# %d regressions beyond %.1f%%" % (regressions, args.threshold))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,433 @@
+/*
+ * --mode=contention
+ *
+ * Ranks 0 and 1 run the regular window sweep while background traffic
+ * loads the system, once per level in --load-rates. The background comes
+ * from --load-source:
+ *
+ *   ranks   every rank from 2 up is a generator (at least 4 processes);
+ *           map them next to the measured pair to load the same node and
+ *           links
+ *   thread  a helper thread on each measured rank drives the load to the
+ *           other measured rank over a duplicate communicator, sharing the
+ *           pair's link and the library's progress engine
+ *
+ * and has the shape given by --load:
+ *
+ *   bulk     pairs of generators exchange --load-size messages (1 MiB)
+ *   flood    pairs of generators exchange bursts of 64 small messages
+ *            (64 bytes)
+ *   alltoall the generators run MPI_Alltoall with --load-size bytes per
+ *            peer (64 KiB)
+ *
+ * A rate is the MB/s each generator sends; 0 is the idle baseline and
+ * "max" leaves the load unthrottled. Generators pace themselves by
+ * sleeping until their byte count is due. They run in rounds that both
+ * sides of an exchange complete together, and the leading generator of
+ * each pair (or of the all-to-all) carries the stop decision in the first
+ * byte of its messages, so no message is ever left unmatched when the
+ * pair finishes the level. Ranks learn that the pair is done through an
+ * MPI_Ibarrier the pair enters after its last size; threads through a
+ * flag.
+ *
+ * Rows report the pair's bandwidth, the percentage of the first level and
+ * the median and 99th percentile of the per-window time. After each level
+ * the background bandwidth the generators actually achieved is printed.
+ * The mode runs under MPI_THREAD_MULTIPLE for every source, so the idle
+ * level pays the same library locking as the loaded ones.
+ */
+#define _GNU_SOURCE
+#include "bibw.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FLOOD_BURST 64
+#define LOAD_TAG 300
+
+struct load_gen {
+    MPI_Comm comm;
+    int rank;                         /* in comm */
+    int size;
+    int peer;                         /* bulk/flood partner, -1 idle */
+    int leader;                       /* decides when to stop */
+    double rate;                      /* bytes per second, < 0 unthrottled */
+    size_t msg;
+    char *s_buf;
+    char *r_buf;
+    MPI_Request req[2 * FLOOD_BURST];
+    MPI_Request *stop_req;            /* ranks: the end-of-level Ibarrier */
+    atomic_int *stop_flag;            /* thread: set by the main thread */
+    double bytes;                     /* sent in this level */
+    double elapsed;
+};
+
+static const char *load_name(int load)
+{
+    switch (load) {
+        case BIBW_LOAD_BULK:
+            return "bulk";
+        case BIBW_LOAD_FLOOD:
+            return "flood";
+        case BIBW_LOAD_ALLTOALL:
+            return "alltoall";
+    }
+    return "unknown";
+}
+
+static size_t load_msg_size(void)
+{
+    if (bibw_options.load_size > 0) {
+        return bibw_options.load_size;
+    }
+    switch (bibw_options.load) {
+        case BIBW_LOAD_FLOOD:
+            return 64;
+        case BIBW_LOAD_ALLTOALL:
+            return 64 * 1024;
+    }
+    return 1024 * 1024;
+}
+
+static void rate_label(double rate, char *label, size_t len)
+{
+    if (rate < 0.0) {
+        snprintf(label, len, "max");
+    } else if (0.0 == rate) {
+        snprintf(label, len, "idle");
+    } else {
+        snprintf(label, len, "%g", rate);
+    }
+}
+
+static int gen_init(struct load_gen *g, MPI_Comm comm)
+{
+    size_t bytes = 0;
+
+    memset(g, 0, sizeof(*g));
+    g->comm = comm;
+    MPI_CHECK(MPI_Comm_rank(comm, &g->rank));
+    MPI_CHECK(MPI_Comm_size(comm, &g->size));
+    g->msg = load_msg_size();
+    if (BIBW_LOAD_ALLTOALL == bibw_options.load) {
+        g->peer = g->size > 1 ? 0 : -1;
+        g->leader = 0 == g->rank;
+        bytes = g->msg * g->size;
+    } else {
+        g->peer = (g->rank ^ 1) < g->size ? g->rank ^ 1 : -1;
+        g->leader = 0 == g->rank % 2;
+        bytes = BIBW_LOAD_FLOOD == bibw_options.load ? g->msg * FLOOD_BURST
+                                                     : g->msg;
+    }
+    g->s_buf = calloc(bytes, 1);
+    g->r_buf = calloc(bytes, 1);
+    return NULL == g->s_buf || NULL == g->r_buf ? -1 : 0;
+}
+
+static void gen_free(struct load_gen *g)
+{
+    free(g->s_buf);
+    free(g->r_buf);
+}
+
+/* Sleep until MPI_Wtime() reaches due */
+static void pace(double due)
+{
+    struct timespec ts;
+    double wait = due - MPI_Wtime();
+
+    if (wait <= 0.0) {
+        return;
+    }
+    ts.tv_sec = (time_t)wait;
+    ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+static int stop_due(struct load_gen *g)
+{
+    int flag = 0;
+
+    if (NULL != g->stop_req) {
+        MPI_CHECK(MPI_Test(g->stop_req, &flag, MPI_STATUS_IGNORE));
+        return flag;
+    }
+    return atomic_load_explicit(g->stop_flag, memory_order_acquire);
+}
+
+/* One round of load; returns the leader's stop decision */
+static int gen_round(struct load_gen *g, int stop)
+{
+    int n = 0, k = 0;
+
+    if (g->leader) {
+        if (BIBW_LOAD_ALLTOALL == bibw_options.load) {
+            for (k = 0; k < g->size; k++) {
+                g->s_buf[k * g->msg] = (char)stop;
+            }
+        } else {
+            g->s_buf[0] = (char)stop;
+        }
+    }
+    switch (bibw_options.load) {
+        case BIBW_LOAD_ALLTOALL:
+            MPI_CHECK(MPI_Alltoall(g->s_buf, g->msg, MPI_CHAR, g->r_buf,
+                                   g->msg, MPI_CHAR, g->comm));
+            g->bytes += (double)g->msg * (g->size - 1);
+            break;
+        case BIBW_LOAD_FLOOD:
+            n = FLOOD_BURST;
+            /* fall through */
+        default:
+            n = n > 0 ? n : 1;
+            for (k = 0; k < n; k++) {
+                MPI_CHECK(MPI_Irecv(g->r_buf + k * g->msg, g->msg, MPI_CHAR,
+                                    g->peer, LOAD_TAG, g->comm, g->req + k));
+            }
+            for (k = 0; k < n; k++) {
+                MPI_CHECK(MPI_Isend(g->s_buf + k * g->msg, g->msg, MPI_CHAR,
+                                    g->peer, LOAD_TAG, g->comm,
+                                    g->req + n + k));
+            }
+            MPI_CHECK(MPI_Waitall(2 * n, g->req, MPI_STATUSES_IGNORE));
+            g->bytes += (double)g->msg * n;
+            break;
+    }
+    /* The block from the leader starts the receive buffer in every shape */
+    return g->leader ? stop : g->r_buf[0];
+}
+
+/* Generate load at g->rate until the leader sees the stop signal */
+static void gen_run(struct load_gen *g)
+{
+    double t_start = MPI_Wtime();
+    int stop = 0;
+
+    g->bytes = 0.0;
+    while (!stop) {
+        if (g->rate > 0.0) {
+            pace(t_start + g->bytes / g->rate);
+        }
+        stop = gen_round(g, g->leader ? stop_due(g) : 0);
+    }
+    g->elapsed = MPI_Wtime() - t_start;
+}
+
+static void *gen_thread(void *arg)
+{
+    gen_run(arg);
+    return NULL;
+}
+
+/* The window sweep on the pair; rank 0 prints a row per size */
+static void measure(struct bibw_window_t *w, struct bibw_hist_t *hist,
+                    double *baseline, int level, const char *label)
+{
+    struct bibw_result_t result = {0, "MPI_CHAR", "contention", 0, 0, 0.0,
+                                   NULL};
+    char tags[BIBW_METRIC_TAGS_LEN], engine[32];
+    double t = 0.0, total = 0.0, bw = 0.0;
+    int iterations = options.iterations, skip = options.skip, i = 0, s = 0;
+    size_t size = 0;
+
+    snprintf(engine, sizeof(engine), "contention-%s", label);
+    result.engine = engine;
+    result.window = options.window_size;
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2, s++) {
+        if (bibw_window_set_size(w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            iterations = options.iterations_large;
+            skip = options.skip_large;
+        }
+        bibw_hist_reset(hist);
+        total = 0.0;
+        MPI_CHECK(MPI_Barrier(w->comm));
+        for (i = 0; i < iterations + skip; i++) {
+            t = MPI_Wtime();
+            bibw_window_exchange(w);
+            if (i >= skip) {
+                t = MPI_Wtime() - t;
+                total += t;
+                bibw_hist_record(hist, t);
+            }
+        }
+        if (0 != w->rank) {
+            continue;
+        }
+        bw = size / 1e6 * iterations * options.window_size * 2 / total;
+        if (0 == level) {
+            baseline[s] = bw;
+        }
+        fprintf(stdout, "%-10s%-10zu%*.*f%*.*f%*.*f%*.*f\n", label, size,
+                FIELD_WIDTH, FLOAT_PRECISION, bw, FIELD_WIDTH,
+                FLOAT_PRECISION, baseline[s] > 0.0 ? 100.0 * bw / baseline[s]
+                                                   : 0.0,
+                FIELD_WIDTH, FLOAT_PRECISION,
+                bibw_hist_quantile(hist, 0.50) * 1e6, FIELD_WIDTH,
+                FLOAT_PRECISION, bibw_hist_quantile(hist, 0.99) * 1e6);
+        fflush(stdout);
+        snprintf(tags, sizeof(tags), "size:%zu,load:%s", size, label);
+        bibw_hist_emit(hist, "mpi_benchmark.contention.window", tags);
+        result.size = size;
+        result.iterations = iterations;
+        result.bandwidth = bw;
+        bibw_output_result(&result);
+    }
+}
+
+int bibw_mode_contention(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_window_t w;
+    struct load_gen gen;
+    struct bibw_hist_t *hist = NULL;
+    MPI_Comm pair_comm = MPI_COMM_NULL, gen_comm = MPI_COMM_NULL;
+    MPI_Request stop_req = MPI_REQUEST_NULL;
+    pthread_t thread;
+    atomic_int stop_flag;
+    double *baseline = NULL, bytes = 0.0, elapsed = 0.0;
+    char label[16];
+    int threads = BIBW_LOAD_THREAD == bibw_options.load_source;
+    int measured = rank < 2, generator = 0, active = 0;
+    int provided = 0, level = 0, nsizes = 0, generators = 0;
+    size_t size = 0;
+
+    MPI_CHECK(MPI_Query_thread(&provided));
+    if (threads && provided < MPI_THREAD_MULTIPLE) {
+        if (0 == rank) {
+            fprintf(stderr, "--load-source=thread needs MPI_THREAD_MULTIPLE, "
+                            "the MPI library provides level %d\n",
+                    provided);
+        }
+        return 1;
+    }
+    if (numprocs < (threads ? 2 : 4)) {
+        if (0 == rank) {
+            fprintf(stderr, "contention mode needs at least %d processes "
+                            "with --load-source=%s\n",
+                    threads ? 2 : 4, threads ? "thread" : "ranks");
+        }
+        return 1;
+    }
+
+    MPI_CHECK(MPI_Comm_split(comm, measured ? 0 : 1, rank, &pair_comm));
+    generator = threads ? measured : !measured;
+    if (generator) {
+        if (threads) {
+            MPI_CHECK(MPI_Comm_dup(pair_comm, &gen_comm));
+        } else {
+            gen_comm = pair_comm;
+        }
+        if (gen_init(&gen, gen_comm)) {
+            OMB_ERROR_EXIT("Unable to allocate memory");
+        }
+        if (threads) {
+            gen.stop_flag = &stop_flag;
+        } else {
+            gen.stop_req = &stop_req;
+        }
+    }
+    generators = threads ? 2 : numprocs - 2;
+
+    if (measured) {
+        if (bibw_window_init(&w, pair_comm, rank, 1 - rank,
+                             options.window_size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        for (size = options.min_message_size;
+             size <= options.max_message_size; size *= 2) {
+            nsizes++;
+        }
+        baseline = calloc(nsizes > 0 ? nsizes : 1, sizeof(double));
+        hist = malloc(sizeof(struct bibw_hist_t));
+        if (NULL == baseline || NULL == hist) {
+            OMB_ERROR_EXIT("Unable to allocate memory");
+        }
+    }
+
+    if (0 == rank) {
+        fprintf(stdout, "# Contention: %s load of %zu-byte messages from %d "
+                        "generator %s, rates in MB/s per generator\n",
+                load_name(bibw_options.load), load_msg_size(),
+                generators, threads ? "threads" : "ranks");
+        if (!threads && BIBW_LOAD_ALLTOALL != bibw_options.load &&
+            generators % 2) {
+            fprintf(stdout, "# Odd number of generator ranks, the last one "
+                            "stays idle\n");
+        }
+        fprintf(stdout, "%-10s%-10s%*s%*s%*s%*s\n", "# Load", "Size",
+                FIELD_WIDTH, "Bandwidth (MB/s)", FIELD_WIDTH, "% of first",
+                FIELD_WIDTH, "p50 window (us)", FIELD_WIDTH,
+                "p99 window (us)");
+        fflush(stdout);
+    }
+
+    for (level = 0; level < bibw_options.num_load_rates; level++) {
+        rate_label(bibw_options.load_rates[level], label, sizeof(label));
+        active = generator && 0.0 != bibw_options.load_rates[level] &&
+                 gen.peer >= 0;
+        if (generator) {
+            gen.rate = bibw_options.load_rates[level] * 1e6;
+            gen.bytes = 0.0;
+            gen.elapsed = 0.0;
+        }
+        MPI_CHECK(MPI_Barrier(comm));
+        if (threads) {
+            if (active) {
+                atomic_init(&stop_flag, 0);
+                if (pthread_create(&thread, NULL, gen_thread, &gen)) {
+                    OMB_ERROR_EXIT("Unable to create load thread");
+                }
+            }
+            if (measured) {
+                measure(&w, hist, baseline, level, label);
+            }
+            if (active) {
+                atomic_store_explicit(&stop_flag, 1, memory_order_release);
+                pthread_join(thread, NULL);
+            }
+        } else {
+            if (generator) {
+                MPI_CHECK(MPI_Ibarrier(comm, &stop_req));
+                if (active) {
+                    gen_run(&gen);
+                }
+            } else {
+                measure(&w, hist, baseline, level, label);
+                MPI_CHECK(MPI_Ibarrier(comm, &stop_req));
+            }
+            MPI_CHECK(MPI_Wait(&stop_req, MPI_STATUS_IGNORE));
+        }
+
+        bytes = generator ? gen.bytes : 0.0;
+        elapsed = generator ? gen.elapsed : 0.0;
+        MPI_CHECK(MPI_Reduce(0 == rank ? MPI_IN_PLACE : &bytes, &bytes, 1,
+                             MPI_DOUBLE, MPI_SUM, 0, comm));
+        MPI_CHECK(MPI_Reduce(0 == rank ? MPI_IN_PLACE : &elapsed, &elapsed, 1,
+                             MPI_DOUBLE, MPI_MAX, 0, comm));
+        if (0 == rank) {
+            fprintf(stdout, "# Background at %s: %.2f MB/s achieved in total\n",
+                    label, elapsed > 0.0 ? bytes / 1e6 / elapsed : 0.0);
+            fflush(stdout);
+        }
+    }
+
+    if (generator) {
+        gen_free(&gen);
+        if (threads) {
+            MPI_CHECK(MPI_Comm_free(&gen_comm));
+        }
+    }
+    if (measured) {
+        bibw_window_free(&w);
+        free(baseline);
+        free(hist);
+    }
+    MPI_CHECK(MPI_Comm_free(&pair_comm));
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * --mode=converge
+ *
+ * Instead of a fixed iteration count, each size runs batches of
+ * --ci-batch windows until the 95% confidence interval of the per-window
+ * bandwidth is narrower than --ci-target percent of its mean, or until
+ * --ci-max-time seconds have passed. Stable large sizes finish after a few
+ * batches; noisy small ones keep sampling.
+ *
+ * Both ranks must stop after the same batch. After every batch each rank
+ * starts an MPI_Iallreduce of its (timed out, not converged) flags and
+ * only waits for it after the next batch, so the agreement costs no extra
+ * round trip on the timed path; the price is running one batch past the
+ * point of convergence, which is kept in the sample.
+ */
+#include "bibw.h"
+#include <math.h>
+#include <stdio.h>
+
+/* A CI from a single batch is too easily narrow by luck */
+#define MIN_BATCHES 3
+
+enum { FLAG_TIMED_OUT, FLAG_NOT_CONVERGED, NUM_FLAGS };
+
+int bibw_mode_converge(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_window_t w;
+    struct bibw_stats_t st = {0};
+    MPI_Request vote = MPI_REQUEST_NULL;
+    int local[NUM_FLAGS], global[NUM_FLAGS];
+    double t_begin = 0.0, t_start = 0.0, mb = 0.0, ci = 0.0;
+    int skip = options.skip, b = 0, i = 0, stop = 0;
+    struct bibw_result_t result = {0, "MPI_CHAR", NULL, 0, 0, 0.0, NULL};
+    size_t size = 0;
+
+    (void)numprocs;
+    if (bibw_window_init(&w, comm, rank, 1 - rank, options.window_size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    result.engine = w.engine->name;
+    result.window = w.window_size;
+    result.windows = &st;
+    if (0 == rank) {
+        fprintf(stdout, "# Convergence: 95%% CI within %.2f%% of the mean, "
+                        "%d windows per batch, at most %.1f s per size\n",
+                bibw_options.ci_target, bibw_options.ci_batch,
+                bibw_options.ci_max_time);
+        fprintf(stdout, "%-10s%*s%*s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "Mean (MB/s)", FIELD_WIDTH, "Median (MB/s)", FIELD_WIDTH,
+                "Stddev (MB/s)", FIELD_WIDTH, "CI95 (+/- %)", FIELD_WIDTH,
+                "Samples", FIELD_WIDTH, "Time (s)");
+        fflush(stdout);
+    }
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (bibw_window_set_size(&w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            skip = options.skip_large;
+        }
+        mb = size / 1e6 * w.window_size * 2;
+        bibw_stats_reset(&st);
+
+        MPI_CHECK(MPI_Barrier(comm));
+        for (i = 0; i < skip; i++) {
+            bibw_window_exchange(&w);
+        }
+        t_begin = MPI_Wtime();
+        for (b = 0, stop = 0; !stop; b++) {
+            for (i = 0; i < bibw_options.ci_batch; i++) {
+                t_start = MPI_Wtime();
+                bibw_window_exchange(&w);
+                bibw_stats_add(&st, mb / (MPI_Wtime() - t_start));
+            }
+            /* Collect the vote started after the previous batch */
+            if (b > 0) {
+                MPI_CHECK(MPI_Wait(&vote, MPI_STATUS_IGNORE));
+                stop = global[FLAG_TIMED_OUT] || !global[FLAG_NOT_CONVERGED];
+            }
+            if (!stop) {
+                local[FLAG_TIMED_OUT] =
+                    MPI_Wtime() - t_begin > bibw_options.ci_max_time;
+                local[FLAG_NOT_CONVERGED] =
+                    b + 1 < MIN_BATCHES ||
+                    !(bibw_stats_ci95(&st) / st.mean * 100.0 <=
+                      bibw_options.ci_target);
+                MPI_CHECK(MPI_Iallreduce(local, global, NUM_FLAGS, MPI_INT,
+                                         MPI_MAX, comm, &vote));
+            }
+        }
+
+        if (0 == rank) {
+            ci = bibw_stats_ci95(&st) / st.mean * 100.0;
+            fprintf(stdout, "%-*zu%*.*f%*.*f%*.*f%*.*f%*zu%*.*f%s\n", 10, size,
+                    FIELD_WIDTH, FLOAT_PRECISION, st.mean, FIELD_WIDTH,
+                    FLOAT_PRECISION, bibw_stats_median(&st), FIELD_WIDTH,
+                    FLOAT_PRECISION, bibw_stats_stddev(&st), FIELD_WIDTH,
+                    FLOAT_PRECISION, ci, FIELD_WIDTH, st.n, FIELD_WIDTH,
+                    FLOAT_PRECISION, MPI_Wtime() - t_begin,
+                    global[FLAG_TIMED_OUT] && ci > bibw_options.ci_target
+                        ? "  (time cap)"
+                        : "");
+            fflush(stdout);
+            result.size = size;
+            result.bandwidth = st.mean;
+            result.iterations = (int)st.n;
+            bibw_output_result(&result);
+        }
+    }
+
+    bibw_stats_free(&st);
+    bibw_window_free(&w);
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ * --mode=ddt
+ *
+ * Non-contiguous messages: the MPI library's derived datatypes against
+ * packing by hand. A message is a layout of blocks of doubles in a strided
+ * buffer:
+ *
+ *   vector    --ddt-block doubles every --ddt-stride doubles
+ *   indexed   block lengths cycling through 1/2, 1 and 3/2 of --ddt-block,
+ *             every other block shifted by one double
+ *
+ * and each size (the payload, rounded down to whole blocks) is exchanged
+ * three ways over the same buffers:
+ *
+ *   MPI type    MPI_Type_vector / MPI_Type_indexed straight from the
+ *               strided buffers
+ *   pack        each message packed into a contiguous buffer, sent, and
+ *               unpacked at the receiver once the window has arrived
+ *   pipelined   each message split into --ddt-chunks chunks; chunk k is
+ *               sent while chunk k + 1 is packed, and the receiver unpacks
+ *               every chunk as it arrives
+ *
+ * Packing and unpacking are inside the timed windows, so the bandwidths
+ * compare what a halo exchange would see. The copy kernels use compiler
+ * vector extensions, with a four-way strided gather for single-double
+ * blocks. After each path the receive buffer is checked against the
+ * layout, outside the timing.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef double v4d __attribute__((vector_size(32), aligned(8)));
+
+struct layout {
+    int nblocks;
+    int regular;                      /* vector: disp = i * stride */
+    int block;
+    int stride;
+    int *disp;                        /* in doubles, into the strided buffer */
+    int *len;
+    size_t *pos;                      /* packed offset of block i, nblocks + 1 */
+    size_t extent;                    /* doubles spanned by the layout */
+    MPI_Datatype type;
+};
+
+enum { PATH_MPI, PATH_PACK, PATH_PIPELINED, NUM_PATHS };
+
+static const char *const path_names[NUM_PATHS] = {
+    "ddt-mpi",
+    "ddt-pack",
+    "ddt-pipelined",
+};
+
+static void copy_block(double *restrict dst, const double *restrict src,
+                       int n)
+{
+    int i = 0;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        *(v4d *)(dst + i) = *(const v4d *)(src + i);
+    }
+    for (; i < n; i++) {
+        dst[i] = src[i];
+    }
+}
+
+/* Blocks [b0, b1) of the layout from strided src into packed dst */
+static void pack(const struct layout *l, double *restrict dst,
+                 const double *restrict src, int b0, int b1)
+{
+    int i = 0;
+
+    dst += l->pos[b0];
+    if (l->regular && 1 == l->block) {
+        src += (size_t)b0 * l->stride;
+        for (i = b0; i + 4 <= b1; i += 4, src += 4 * l->stride, dst += 4) {
+            v4d g = {src[0], src[l->stride], src[2 * l->stride],
+                     src[3 * l->stride]};
+
+            *(v4d *)dst = g;
+        }
+        for (; i < b1; i++, src += l->stride) {
+            *dst++ = *src;
+        }
+        return;
+    }
+    for (i = b0; i < b1; i++) {
+        copy_block(dst, src + l->disp[i], l->len[i]);
+        dst += l->len[i];
+    }
+}
+
+static void unpack(const struct layout *l, double *restrict dst,
+                   const double *restrict src, int b0, int b1)
+{
+    int i = 0;
+
+    src += l->pos[b0];
+    if (l->regular && 1 == l->block) {
+        dst += (size_t)b0 * l->stride;
+        for (i = b0; i + 4 <= b1; i += 4, dst += 4 * l->stride, src += 4) {
+            v4d s = *(const v4d *)src;
+
+            dst[0] = s[0];
+            dst[l->stride] = s[1];
+            dst[2 * l->stride] = s[2];
+            dst[3 * l->stride] = s[3];
+        }
+        for (; i < b1; i++, dst += l->stride) {
+            *dst = *src++;
+        }
+        return;
+    }
+    for (i = b0; i < b1; i++) {
+        copy_block(dst + l->disp[i], src, l->len[i]);
+        src += l->len[i];
+    }
+}
+
+static void layout_free(struct layout *l)
+{
+    if (MPI_DATATYPE_NULL != l->type) {
+        MPI_CHECK(MPI_Type_free(&l->type));
+    }
+    free(l->disp);
+    free(l->len);
+    free(l->pos);
+    memset(l, 0, sizeof(*l));
+    l->type = MPI_DATATYPE_NULL;
+}
+
+/* Layout of about payload bytes; 0 if it holds no whole block */
+static int layout_init(struct layout *l, size_t payload, int indexed)
+{
+    int b = bibw_options.ddt_block, s = bibw_options.ddt_stride, i = 0;
+
+    memset(l, 0, sizeof(*l));
+    l->type = MPI_DATATYPE_NULL;
+    l->nblocks = (int)(payload / sizeof(double) / b);
+    if (0 == l->nblocks) {
+        return 0;
+    }
+    l->regular = !indexed;
+    l->block = b;
+    l->stride = s;
+    l->disp = malloc(sizeof(int) * l->nblocks);
+    l->len = malloc(sizeof(int) * l->nblocks);
+    l->pos = malloc(sizeof(size_t) * (l->nblocks + 1));
+    OMB_CHECK_NULL_AND_EXIT(l->disp, "Unable to allocate memory");
+    OMB_CHECK_NULL_AND_EXIT(l->len, "Unable to allocate memory");
+    OMB_CHECK_NULL_AND_EXIT(l->pos, "Unable to allocate memory");
+
+    l->pos[0] = 0;
+    for (i = 0; i < l->nblocks; i++) {
+        l->disp[i] = i * s;
+        l->len[i] = b;
+        if (indexed) {
+            l->len[i] = b * (1 + i % 3) / 2 > 0 ? b * (1 + i % 3) / 2 : 1;
+            l->disp[i] += i % 2;
+        }
+        l->pos[i + 1] = l->pos[i] + l->len[i];
+    }
+    l->extent = (size_t)l->disp[l->nblocks - 1] + l->len[l->nblocks - 1];
+    if (indexed) {
+        MPI_CHECK(MPI_Type_indexed(l->nblocks, l->len, l->disp, MPI_DOUBLE,
+                                   &l->type));
+    } else {
+        MPI_CHECK(MPI_Type_vector(l->nblocks, b, s, MPI_DOUBLE, &l->type));
+    }
+    MPI_CHECK(MPI_Type_commit(&l->type));
+
+    return 1;
+}
+
+struct ddt_state {
+    MPI_Comm comm;
+    int peer, send_tag, recv_tag, window, chunks;
+    struct layout l;
+    double *s_strided, *r_strided;
+    double **s_pack, **r_pack;        /* one contiguous buffer per message */
+    MPI_Request *send_request, *recv_request;
+};
+
+static void window_mpi(struct ddt_state *st)
+{
+    int j = 0;
+
+    for (j = 0; j < st->window; j++) {
+        MPI_CHECK(MPI_Irecv(st->r_strided, 1, st->l.type, st->peer,
+                            st->recv_tag, st->comm, st->recv_request + j));
+    }
+    for (j = 0; j < st->window; j++) {
+        MPI_CHECK(MPI_Isend(st->s_strided, 1, st->l.type, st->peer,
+                            st->send_tag, st->comm, st->send_request + j));
+    }
+    MPI_CHECK(MPI_Waitall(st->window, st->send_request, MPI_STATUSES_IGNORE));
+    MPI_CHECK(MPI_Waitall(st->window, st->recv_request, MPI_STATUSES_IGNORE));
+}
+
+/*
+ * chunks = 1 is the plain pack path: whole messages, unpacked after the
+ * window. With more, message j's chunk k is a message of its own and is
+ * unpacked as soon as it completes.
+ */
+static void window_pack(struct ddt_state *st, int chunks)
+{
+    int n = st->l.nblocks, per = (n + chunks - 1) / chunks;
+    int j = 0, b0 = 0, b1 = 0, r = 0;
+
+    for (j = 0, r = 0; j < st->window; j++) {
+        for (b0 = 0; b0 < n; b0 += per, r++) {
+            b1 = b0 + per < n ? b0 + per : n;
+            MPI_CHECK(MPI_Irecv(st->r_pack[j] + st->l.pos[b0],
+                                (int)(st->l.pos[b1] - st->l.pos[b0]),
+                                MPI_DOUBLE, st->peer, st->recv_tag, st->comm,
+                                st->recv_request + r));
+        }
+    }
+    for (j = 0, r = 0; j < st->window; j++) {
+        for (b0 = 0; b0 < n; b0 += per, r++) {
+            b1 = b0 + per < n ? b0 + per : n;
+            pack(&st->l, st->s_pack[j], st->s_strided, b0, b1);
+            MPI_CHECK(MPI_Isend(st->s_pack[j] + st->l.pos[b0],
+                                (int)(st->l.pos[b1] - st->l.pos[b0]),
+                                MPI_DOUBLE, st->peer, st->send_tag, st->comm,
+                                st->send_request + r));
+        }
+    }
+    if (1 == chunks) {
+        MPI_CHECK(MPI_Waitall(st->window, st->recv_request,
+                              MPI_STATUSES_IGNORE));
+        for (j = 0; j < st->window; j++) {
+            unpack(&st->l, st->r_strided, st->r_pack[j], 0, n);
+        }
+    } else {
+        for (j = 0, r = 0; j < st->window; j++) {
+            for (b0 = 0; b0 < n; b0 += per, r++) {
+                b1 = b0 + per < n ? b0 + per : n;
+                MPI_CHECK(MPI_Wait(st->recv_request + r, MPI_STATUS_IGNORE));
+                unpack(&st->l, st->r_strided, st->r_pack[j], b0, b1);
+            }
+        }
+    }
+    MPI_CHECK(MPI_Waitall(r, st->send_request, MPI_STATUSES_IGNORE));
+}
+
+static void run_window(struct ddt_state *st, int path)
+{
+    switch (path) {
+        case PATH_MPI:
+            window_mpi(st);
+            break;
+        case PATH_PACK:
+            window_pack(st, 1);
+            break;
+        case PATH_PIPELINED:
+            window_pack(st, st->chunks);
+            break;
+    }
+}
+
+/* Elements of the layout in r_strided that differ from the sender's */
+static int check(const struct ddt_state *st)
+{
+    const struct layout *l = &st->l;
+    int i = 0, e = 0, errors = 0;
+
+    for (i = 0; i < l->nblocks; i++) {
+        for (e = 0; e < l->len[i]; e++) {
+            errors += st->r_strided[l->disp[i] + e] !=
+                      st->s_strided[l->disp[i] + e];
+        }
+    }
+    return errors;
+}
+
+int bibw_mode_ddt(MPI_Comm comm, int rank, int numprocs)
+{
+    struct ddt_state st;
+    struct bibw_result_t result = {0, NULL, NULL, 0, 0, 0.0, NULL};
+    double t[NUM_PATHS], t_start = 0.0, mb = 0.0;
+    int iterations = options.iterations, skip = options.skip;
+    int indexed = BIBW_DDT_INDEXED == bibw_options.ddt_layout;
+    int i = 0, j = 0, p = 0, errors = 0, chunks = 0;
+    size_t size = 0, payload = 0, x = 0;
+
+    (void)numprocs;
+    if (bibw_options.ddt_stride < 2 * bibw_options.ddt_block) {
+        if (0 == rank) {
+            fprintf(stderr, "--ddt-stride must be at least twice "
+                            "--ddt-block\n");
+        }
+        return 1;
+    }
+    memset(&st, 0, sizeof(st));
+    st.comm = comm;
+    st.peer = 1 - rank;
+    st.send_tag = rank < st.peer ? 100 : 10;
+    st.recv_tag = rank < st.peer ? 10 : 100;
+    st.window = options.window_size;
+    st.s_pack = calloc(st.window, sizeof(double *));
+    st.r_pack = calloc(st.window, sizeof(double *));
+    st.send_request = malloc(sizeof(MPI_Request) * st.window *
+                             bibw_options.ddt_chunks);
+    st.recv_request = malloc(sizeof(MPI_Request) * st.window *
+                             bibw_options.ddt_chunks);
+    if (NULL == st.s_pack || NULL == st.r_pack || NULL == st.send_request ||
+        NULL == st.recv_request) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+    result.datatype = indexed ? "indexed" : "vector";
+    result.window = st.window;
+
+    if (0 == rank) {
+        fprintf(stdout, "# Derived datatypes: %s layout, %d-double blocks "
+                        "every %d doubles, %d pipeline chunks\n",
+                result.datatype, bibw_options.ddt_block,
+                bibw_options.ddt_stride, bibw_options.ddt_chunks);
+        fprintf(stdout, "%-10s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "MPI type (MB/s)", FIELD_WIDTH, "Pack (MB/s)", FIELD_WIDTH,
+                "Pipelined (MB/s)", FIELD_WIDTH, "Best pack speed-up");
+        fflush(stdout);
+    }
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (!layout_init(&st.l, size, indexed)) {
+            continue;
+        }
+        payload = st.l.pos[st.l.nblocks] * sizeof(double);
+        chunks = bibw_options.ddt_chunks < st.l.nblocks
+                     ? bibw_options.ddt_chunks
+                     : st.l.nblocks;
+        st.chunks = chunks;
+        if (payload > LARGE_MESSAGE_SIZE) {
+            iterations = options.iterations_large;
+            skip = options.skip_large;
+        }
+        st.s_strided = malloc(sizeof(double) * st.l.extent);
+        st.r_strided = malloc(sizeof(double) * st.l.extent);
+        OMB_CHECK_NULL_AND_EXIT(st.s_strided, "Unable to allocate memory");
+        OMB_CHECK_NULL_AND_EXIT(st.r_strided, "Unable to allocate memory");
+        for (x = 0; x < st.l.extent; x++) {
+            st.s_strided[x] = (double)x;
+        }
+        for (j = 0; j < st.window; j++) {
+            st.s_pack[j] = malloc(payload);
+            st.r_pack[j] = malloc(payload);
+            OMB_CHECK_NULL_AND_EXIT(st.s_pack[j], "Unable to allocate memory");
+            OMB_CHECK_NULL_AND_EXIT(st.r_pack[j], "Unable to allocate memory");
+            memset(st.s_pack[j], 0, payload);
+            memset(st.r_pack[j], 0, payload);
+        }
+
+        for (p = 0; p < NUM_PATHS; p++) {
+            memset(st.r_strided, 0, sizeof(double) * st.l.extent);
+            MPI_CHECK(MPI_Barrier(comm));
+            for (i = 0; i < iterations + skip; i++) {
+                if (i == skip) {
+                    t_start = MPI_Wtime();
+                }
+                run_window(&st, p);
+            }
+            t[p] = MPI_Wtime() - t_start;
+            errors += check(&st);
+        }
+
+        if (0 == rank) {
+            mb = payload / 1e6 * iterations * st.window * 2;
+            fprintf(stdout, "%-*zu%*.*f%*.*f%*.*f%*.*f\n", 10, payload,
+                    FIELD_WIDTH, FLOAT_PRECISION, mb / t[PATH_MPI],
+                    FIELD_WIDTH, FLOAT_PRECISION, mb / t[PATH_PACK],
+                    FIELD_WIDTH, FLOAT_PRECISION, mb / t[PATH_PIPELINED],
+                    FIELD_WIDTH, FLOAT_PRECISION,
+                    t[PATH_MPI] / (t[PATH_PACK] < t[PATH_PIPELINED]
+                                       ? t[PATH_PACK]
+                                       : t[PATH_PIPELINED]));
+            fflush(stdout);
+            result.size = payload;
+            result.iterations = iterations;
+            for (p = 0; p < NUM_PATHS; p++) {
+                result.engine = path_names[p];
+                result.bandwidth = mb / t[p];
+                bibw_output_result(&result);
+            }
+        }
+
+        for (j = 0; j < st.window; j++) {
+            free(st.s_pack[j]);
+            free(st.r_pack[j]);
+        }
+        free(st.s_strided);
+        free(st.r_strided);
+        layout_free(&st.l);
+    }
+
+    MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_SUM,
+                            comm));
+    if (0 == rank && errors) {
+        fprintf(stderr, "DDT VALIDATION ERROR: %d elements differ\n", errors);
+    }
+    free(st.s_pack);
+    free(st.r_pack);
+    free(st.send_request);
+    free(st.recv_request);
+    return errors;
+}
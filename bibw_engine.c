@@ -0,0 +1,278 @@
+/*
+ * Window engines.
+ *
+ *   isend        MPI_Irecv/MPI_Isend per message, per window (stock OMB)
+ *   persistent   MPI_Recv_init/MPI_Send_init once per size, MPI_Startall
+ *                per window
+ *   partitioned  MPI_Precv_init/MPI_Psend_init once per size (MPI-4), each
+ *                message split into --partitions partitions marked ready
+ *                with MPI_Pready_range
+ *   rma          MPI_Put of every message into the peer's MPI_Win_allocate
+ *                window inside one MPI_Win_lock_all epoch, MPI_Win_flush
+ *                and a zero-byte notification to the peer per window
+ *   rma-fence    the same puts, each window closed by MPI_Win_fence
+ */
+#include "bibw.h"
+#include <string.h>
+
+#define BUF(b, w, j) ((b)[(w)->nbufs > 1 ? (j) : 0])
+
+static void isend_exchange(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Irecv(BUF(w->r_buf, w, j), w->count, w->dtype, w->peer,
+                            w->recv_tag, w->comm, w->recv_request + j));
+    }
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Isend(BUF(w->s_buf, w, j), w->count, w->dtype, w->peer,
+                            w->send_tag, w->comm, w->send_request + j));
+    }
+    MPI_CHECK(MPI_Waitall(w->window_size, w->send_request,
+                          MPI_STATUSES_IGNORE));
+    MPI_CHECK(MPI_Waitall(w->window_size, w->recv_request,
+                          MPI_STATUSES_IGNORE));
+}
+
+const struct bibw_engine_t bibw_engine_isend = {
+    "isend", NULL, isend_exchange, NULL,
+};
+
+static int persistent_prepare(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Recv_init(BUF(w->r_buf, w, j), w->count, w->dtype,
+                                w->peer, w->recv_tag, w->comm,
+                                w->recv_request + j));
+        MPI_CHECK(MPI_Send_init(BUF(w->s_buf, w, j), w->count, w->dtype,
+                                w->peer, w->send_tag, w->comm,
+                                w->send_request + j));
+    }
+
+    return 0;
+}
+
+/*
+ * Receives are started first so the peer's sends find them posted, the
+ * same ordering the isend engine uses.
+ */
+static void persistent_exchange(struct bibw_window_t *w)
+{
+    MPI_CHECK(MPI_Startall(w->window_size, w->recv_request));
+    MPI_CHECK(MPI_Startall(w->window_size, w->send_request));
+    MPI_CHECK(MPI_Waitall(w->window_size, w->send_request,
+                          MPI_STATUSES_IGNORE));
+    MPI_CHECK(MPI_Waitall(w->window_size, w->recv_request,
+                          MPI_STATUSES_IGNORE));
+}
+
+static void persistent_release(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Request_free(w->recv_request + j));
+        MPI_CHECK(MPI_Request_free(w->send_request + j));
+    }
+}
+
+static const struct bibw_engine_t bibw_engine_persistent = {
+    "persistent", persistent_prepare, persistent_exchange, persistent_release,
+};
+
+#if MPI_VERSION >= 4
+/*
+ * Largest partition count not above --partitions that divides the message
+ * evenly; tiny messages degrade to a single partition.
+ */
+static int partition_count(int count)
+{
+    int p = bibw_options.partitions;
+
+    if (p > count) {
+        p = count > 0 ? count : 1;
+    }
+    while (p > 1 && 0 != count % p) {
+        p--;
+    }
+    return p;
+}
+
+static int partitioned_prepare(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    w->partitions = partition_count(w->count);
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Precv_init(BUF(w->r_buf, w, j), w->partitions,
+                                 w->count / w->partitions, w->dtype, w->peer,
+                                 w->recv_tag, w->comm, MPI_INFO_NULL,
+                                 w->recv_request + j));
+        MPI_CHECK(MPI_Psend_init(BUF(w->s_buf, w, j), w->partitions,
+                                 w->count / w->partitions, w->dtype, w->peer,
+                                 w->send_tag, w->comm, MPI_INFO_NULL,
+                                 w->send_request + j));
+    }
+
+    return 0;
+}
+
+static void partitioned_exchange(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    MPI_CHECK(MPI_Startall(w->window_size, w->recv_request));
+    MPI_CHECK(MPI_Startall(w->window_size, w->send_request));
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Pready_range(0, w->partitions - 1, w->send_request[j]));
+    }
+    MPI_CHECK(MPI_Waitall(w->window_size, w->send_request,
+                          MPI_STATUSES_IGNORE));
+    MPI_CHECK(MPI_Waitall(w->window_size, w->recv_request,
+                          MPI_STATUSES_IGNORE));
+}
+
+static const struct bibw_engine_t bibw_engine_partitioned = {
+    "partitioned", partitioned_prepare, partitioned_exchange,
+    persistent_release,
+};
+#endif /* #if MPI_VERSION >= 4 */
+
+/*
+ * One-sided engines. The window is allocated per size with room for nbufs
+ * messages, so puts land in the same slot layout the receives use; the
+ * origin buffers are the window's send buffers. MPI_Win_allocate lets the
+ * library place the memory (shared segments between ranks of a node,
+ * pre-registered memory on the network).
+ */
+static void rma_allocate(struct bibw_window_t *w, int fence)
+{
+    MPI_Aint lb = 0, extent = 0;
+    MPI_Info info = MPI_INFO_NULL;
+    void *base = NULL;
+
+    MPI_CHECK(MPI_Type_get_extent(w->dtype, &lb, &extent));
+    /* Cache-line aligned slots; zero-byte messages still get one line */
+    w->win_slot = ((size_t)extent * w->count + 63) & ~(size_t)63;
+    if (0 == w->win_slot) {
+        w->win_slot = 64;
+    }
+    MPI_CHECK(MPI_Info_create(&info));
+    MPI_CHECK(MPI_Info_set(info, "same_size", "true"));
+    MPI_CHECK(MPI_Info_set(info, "same_disp_unit", "true"));
+    if (fence) {
+        MPI_CHECK(MPI_Info_set(info, "no_locks", "true"));
+    }
+    MPI_CHECK(MPI_Win_allocate((MPI_Aint)(w->win_slot * w->nbufs), 1, info,
+                               w->comm, &base, &w->win));
+    MPI_CHECK(MPI_Info_free(&info));
+}
+
+static void rma_put(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Put(BUF(w->s_buf, w, j), w->count, w->dtype, w->peer,
+                          (MPI_Aint)(w->win_slot * (w->nbufs > 1 ? j : 0)),
+                          w->count, w->dtype, w->win));
+    }
+}
+
+/*
+ * Passive target: the flush completes this rank's puts at the peer, and a
+ * zero-byte message then tells the peer that its slots were written. A
+ * window ends once both ranks have seen the other's notification, so the
+ * ranks cannot drift apart and every timed window carries both directions,
+ * like a paired isend window.
+ */
+static int rma_lock_prepare(struct bibw_window_t *w)
+{
+    rma_allocate(w, 0);
+    MPI_CHECK(MPI_Win_lock_all(MPI_MODE_NOCHECK, w->win));
+
+    return 0;
+}
+
+static void rma_lock_exchange(struct bibw_window_t *w)
+{
+    rma_put(w);
+    MPI_CHECK(MPI_Win_flush(w->peer, w->win));
+    MPI_CHECK(MPI_Sendrecv(NULL, 0, MPI_CHAR, w->peer, w->send_tag, NULL, 0,
+                           MPI_CHAR, w->peer, w->recv_tag, w->comm,
+                           MPI_STATUS_IGNORE));
+}
+
+static void rma_lock_release(struct bibw_window_t *w)
+{
+    MPI_CHECK(MPI_Win_unlock_all(w->win));
+    MPI_CHECK(MPI_Win_free(&w->win));
+}
+
+static const struct bibw_engine_t bibw_engine_rma = {
+    "rma", rma_lock_prepare, rma_lock_exchange, rma_lock_release,
+};
+
+/* Active target: the fence ends both ranks' epochs, so windows stay paired */
+static int rma_fence_prepare(struct bibw_window_t *w)
+{
+    rma_allocate(w, 1);
+    MPI_CHECK(MPI_Win_fence(MPI_MODE_NOPRECEDE, w->win));
+
+    return 0;
+}
+
+static void rma_fence_exchange(struct bibw_window_t *w)
+{
+    rma_put(w);
+    MPI_CHECK(MPI_Win_fence(0, w->win));
+}
+
+static void rma_fence_release(struct bibw_window_t *w)
+{
+    MPI_CHECK(MPI_Win_fence(MPI_MODE_NOSUCCEED, w->win));
+    MPI_CHECK(MPI_Win_free(&w->win));
+}
+
+static const struct bibw_engine_t bibw_engine_rma_fence = {
+    "rma-fence", rma_fence_prepare, rma_fence_exchange, rma_fence_release,
+};
+
+static const struct bibw_engine_t *bibw_engines[] = {
+    &bibw_engine_isend,
+    &bibw_engine_persistent,
+#if MPI_VERSION >= 4
+    &bibw_engine_partitioned,
+#endif
+    &bibw_engine_rma,
+    &bibw_engine_rma_fence,
+};
+
+#define BIBW_NUM_ENGINE_TYPES (sizeof(bibw_engines) / sizeof(bibw_engines[0]))
+
+const struct bibw_engine_t *bibw_engine_find(const char *name)
+{
+    size_t i = 0;
+
+    for (i = 0; i < BIBW_NUM_ENGINE_TYPES; i++) {
+        if (0 == strcmp(name, bibw_engines[i]->name)) {
+            return bibw_engines[i];
+        }
+    }
+    return NULL;
+}
+
+void bibw_engine_list(FILE *out)
+{
+    size_t i = 0;
+
+    for (i = 0; i < BIBW_NUM_ENGINE_TYPES; i++) {
+        fprintf(out, "%s%s", i ? ", " : "", bibw_engines[i]->name);
+    }
+#if MPI_VERSION < 4
+    fprintf(out, " (partitioned needs an MPI-4 library)");
+#endif
+}
@@ -0,0 +1,90 @@
+/*
+ * Per-size duration histograms and their StatsD summary.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <string.h>
+
+void bibw_hist_reset(struct bibw_hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min_ns = UINT64_MAX;
+}
+
+/* Midpoint of the range of values that land in bucket idx */
+static double bucket_value_ns(int idx)
+{
+    int e = idx / (BIBW_HIST_SUB / 2) - 1;
+    uint64_t mantissa = 0;
+
+    if (idx < BIBW_HIST_SUB) {
+        return idx;
+    }
+    mantissa = (uint64_t)(idx - e * (BIBW_HIST_SUB / 2));
+    return (double)(mantissa << e) + (double)((uint64_t)1 << e) / 2.0;
+}
+
+/*
+ * Value at quantile q (0..1) in seconds. The result is clamped to the
+ * recorded min/max so q = 0 and q = 1 are exact.
+ */
+double bibw_hist_quantile(const struct bibw_hist_t *h, double q)
+{
+    uint64_t rank = 0, seen = 0;
+    double ns = 0.0;
+    int i = 0;
+
+    if (0 == h->count) {
+        return 0.0;
+    }
+    rank = (uint64_t)(q * (double)h->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > h->count) {
+        rank = h->count;
+    }
+    for (i = 0; i < BIBW_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    ns = bucket_value_ns(i);
+    if (ns < (double)h->min_ns) {
+        ns = (double)h->min_ns;
+    }
+    if (ns > (double)h->max_ns) {
+        ns = (double)h->max_ns;
+    }
+
+    return ns / 1e9;
+}
+
+/*
+ * Emit name.p50/.p90/.p99/.p999/.max as StatsD timers (milliseconds) with
+ * the given DogStatsD tags.
+ */
+void bibw_hist_emit(const struct bibw_hist_t *h, const char *name,
+                    const char *tags)
+{
+    static const struct {
+        const char *suffix;
+        double q;
+    } quantiles[] = {
+        {"p50", 0.50}, {"p90", 0.90}, {"p99", 0.99}, {"p999", 0.999},
+    };
+    char metric[BIBW_METRIC_NAME_LEN];
+    size_t i = 0;
+
+    if (0 == h->count) {
+        return;
+    }
+    for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        snprintf(metric, sizeof(metric), "%s.%s", name, quantiles[i].suffix);
+        bibw_telemetry_emit(metric, bibw_hist_quantile(h, quantiles[i].q) * 1e3,
+                            "ms", tags);
+    }
+    snprintf(metric, sizeof(metric), "%s.max", name);
+    bibw_telemetry_emit(metric, h->max_ns / 1e6, "ms", tags);
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Run osu_bibw_modified and osu_bibw_matched.py on the same schedule and
+# split the bandwidth gap into per-call binding overhead and data movement.
+#
+#   MPIRUN="mpirun -np 2 -host a,b" ./bibw_matched.sh [-m MIN:MAX] [-i N] \
+#       [-x N] [-W N] [--engines=persistent]
+#
+# Only the options both sides understand may be passed. Results are kept
+# in $OUT (default ./matched) as c.jsonl and python.jsonl.
+set -e
+
+MPIRUN=${MPIRUN:-"mpirun -np 2"}
+BIBW=${BIBW:-./osu_bibw}
+PYTHON=${PYTHON:-python3}
+OUT=${OUT:-matched}
+HERE=$(dirname "$0")
+
+mkdir -p "$OUT"
+$MPIRUN $BIBW --statsd=off --mode=calls --output=json \
+    --output-file="$OUT/c_calls.jsonl" "$@"
+$MPIRUN $BIBW --statsd=off --output=json --output-file="$OUT/c_bw.jsonl" "$@"
+$MPIRUN $PYTHON "$HERE/osu_bibw_matched.py" --mode=calls --output=json \
+    --output-file="$OUT/python_calls.jsonl" "$@"
+$MPIRUN $PYTHON "$HERE/osu_bibw_matched.py" --output=json \
+    --output-file="$OUT/python_bw.jsonl" "$@"
+
+cat "$OUT/c_calls.jsonl" "$OUT/c_bw.jsonl" > "$OUT/c.jsonl"
+cat "$OUT/python_calls.jsonl" "$OUT/python_bw.jsonl" > "$OUT/python.jsonl"
+"$PYTHON" "$HERE/bibw_compare.py" --decompose "$OUT/c.jsonl" \
+    "$OUT/python.jsonl"
@@ -0,0 +1,683 @@
+/*
+ * Long options understood by osu_bibw_modified on top of the OMB set.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct bibw_options_t bibw_options = {
+    .statsd = 1,
+    .statsd_host = "127.0.0.1",
+    .statsd_port = 8125,
+    .statsd_mtu = 1500,
+    .rounds = 10,
+    .num_engines = 0,
+    .partitions = 4,
+    .arena = BIBW_ARENA_PAGES,
+    .pairing = BIBW_PAIR_BLOCK,
+    .threads = 0,
+    .thread_full_window = 0,
+    .sweep_threshold = 10.0,
+    .sweep_resolution = 256,
+    .tune_max_window = 256,
+    .tune_memory = 256,
+    .tune_budget = 2.0,
+    .tune_flat = 5.0,
+    .ci_target = 1.0,
+    .ci_max_time = 5.0,
+    .ci_batch = 10,
+    .output = BIBW_OUTPUT_TEXT,
+    .output_file = "",
+    .phases = 0,
+    .overlap_kernel = BIBW_KERNEL_TRIAD,
+    .overlap_compute = 100.0,
+    .overlap_poke = 8,
+    .shm_nt = 262144,
+    .num_bind_cpus = 0,
+    .membind = BIBW_MEMBIND_OFF,
+    .num_mem_nodes = 0,
+    .validator = BIBW_VALIDATOR_OMB,
+    .validate_every = 1,
+    .validate_slices = 0,
+    .ddt_layout = BIBW_DDT_VECTOR,
+    .ddt_block = 8,
+    .ddt_stride = 16,
+    .ddt_chunks = 4,
+    .stream_bytes = 64 * 1024 * 1024,
+    .stream_depth = 0,
+    .stream_completion = BIBW_STREAM_WAITSOME,
+    .load = BIBW_LOAD_BULK,
+    .load_source = BIBW_LOAD_RANKS,
+    .load_size = 0,
+    .num_load_rates = 4,
+    .load_rates = {0.0, 100.0, 1000.0, BIBW_LOAD_UNTHROTTLED},
+    .mode = NULL,
+};
+
+static const struct bibw_mode_t bibw_modes[] = {
+    {"telemetry-overhead",
+     "bandwidth with and without the telemetry the size sweep sends",
+     bibw_mode_telemetry_overhead, 0, MPI_THREAD_SINGLE, 0},
+    {"pairs", "aggregate bandwidth of 1..N concurrent rank pairs (even -np)",
+     bibw_mode_pairs, 1, MPI_THREAD_SINGLE, 0},
+    {"threads", "1..T threads per rank exchanging under MPI_THREAD_MULTIPLE",
+     bibw_mode_threads, 0, MPI_THREAD_MULTIPLE, 0},
+    {"sweep", "bisect the size grid to locate bandwidth cliffs",
+     bibw_mode_sweep, 0, MPI_THREAD_SINGLE, 0},
+    {"tune", "search the window depth with peak bandwidth for each size",
+     bibw_mode_tune, 0, MPI_THREAD_SINGLE, 0},
+    {"converge", "sample each size until the 95% CI reaches --ci-target",
+     bibw_mode_converge, 0, MPI_THREAD_SINGLE, 1},
+    {"calls", "per-call cost of zero-byte MPI_Irecv/MPI_Isend/MPI_Waitall",
+     bibw_mode_calls, 0, MPI_THREAD_SINGLE, 1},
+    {"overlap", "bandwidth exchange overlapped with a SIMD compute kernel",
+     bibw_mode_overlap, 0, MPI_THREAD_SINGLE, 0},
+    {"shm", "MPI against a shared-memory copy between co-located ranks",
+     bibw_mode_shm, 0, MPI_THREAD_SINGLE, 1},
+    {"placement", "bandwidth for every core/NUMA node placement of the ranks",
+     bibw_mode_placement, 0, MPI_THREAD_SINGLE, 0},
+    {"ddt", "MPI derived datatypes against SIMD pack/send/unpack",
+     bibw_mode_ddt, 0, MPI_THREAD_SINGLE, 1},
+    {"stream", "requests reposted as MPI_Waitsome/Testsome completes them",
+     bibw_mode_stream, 0, MPI_THREAD_SINGLE, 1},
+    {"contention", "pair bandwidth under background load from ranks or threads",
+     bibw_mode_contention, 1, MPI_THREAD_MULTIPLE, 1},
+};
+
+#define BIBW_NUM_MODES (sizeof(bibw_modes) / sizeof(bibw_modes[0]))
+
+enum bibw_opt_kind {
+    BIBW_OPT_INT,
+    BIBW_OPT_DOUBLE,
+    BIBW_OPT_CUSTOM,
+};
+
+struct bibw_opt_t {
+    const char *name;
+    enum bibw_opt_kind kind;
+    void *dest;
+    int (*parse)(const char *arg);
+    const char *arg_name;
+    const char *help;
+};
+
+static int parse_statsd(const char *arg)
+{
+    const char *colon = NULL;
+    size_t len = 0;
+
+    if (0 == strcmp(arg, "off")) {
+        bibw_options.statsd = 0;
+        return 0;
+    }
+    colon = strrchr(arg, ':');
+    len = colon ? (size_t)(colon - arg) : strlen(arg);
+    if (0 == len || len >= BIBW_HOST_LEN) {
+        return -1;
+    }
+    memcpy(bibw_options.statsd_host, arg, len);
+    bibw_options.statsd_host[len] = '\0';
+    if (colon) {
+        bibw_options.statsd_port = atoi(colon + 1);
+        if (bibw_options.statsd_port <= 0 ||
+            bibw_options.statsd_port > 65535) {
+            return -1;
+        }
+    }
+    bibw_options.statsd = 1;
+    return 0;
+}
+
+static int parse_mode(const char *arg)
+{
+    size_t i = 0;
+
+    for (i = 0; i < BIBW_NUM_MODES; i++) {
+        if (0 == strcmp(arg, bibw_modes[i].name)) {
+            bibw_options.mode = &bibw_modes[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Comma-separated engines measured next to the isend exchange of the
+ * regular sweep. isend itself is always measured, so naming it is a no-op.
+ */
+static int parse_engines(const char *arg)
+{
+    char list[256], *name = NULL, *save = NULL;
+    const struct bibw_engine_t *engine = NULL;
+    int i = 0, seen = 0;
+
+    if (strlen(arg) >= sizeof(list)) {
+        return -1;
+    }
+    strcpy(list, arg);
+    bibw_options.num_engines = 0;
+    for (name = strtok_r(list, ",", &save); NULL != name;
+         name = strtok_r(NULL, ",", &save)) {
+        engine = bibw_engine_find(name);
+        if (NULL == engine) {
+            return -1;
+        }
+        seen = engine == &bibw_engine_isend;
+        for (i = 0; i < bibw_options.num_engines; i++) {
+            seen |= engine == bibw_options.engines[i];
+        }
+        if (seen) {
+            continue;
+        }
+        if (BIBW_MAX_ENGINES == bibw_options.num_engines) {
+            return -1;
+        }
+        bibw_options.engines[bibw_options.num_engines++] = engine;
+    }
+
+    return 0;
+}
+
+static int parse_arena(const char *arg)
+{
+    if (0 == strcmp(arg, "off")) {
+        bibw_options.arena = BIBW_ARENA_OFF;
+    } else if (0 == strcmp(arg, "on")) {
+        bibw_options.arena = BIBW_ARENA_PAGES;
+    } else if (0 == strcmp(arg, "huge")) {
+        bibw_options.arena = BIBW_ARENA_HUGE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_thread_window(const char *arg)
+{
+    if (0 == strcmp(arg, "slice")) {
+        bibw_options.thread_full_window = 0;
+    } else if (0 == strcmp(arg, "full")) {
+        bibw_options.thread_full_window = 1;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_pairing(const char *arg)
+{
+    int i = 0;
+
+    for (i = BIBW_PAIR_BLOCK; i <= BIBW_PAIR_CROSS_NODE; i++) {
+        if (0 == strcmp(arg, bibw_pairing_name(i))) {
+            bibw_options.pairing = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int parse_output(const char *arg)
+{
+    if (0 == strcmp(arg, "text")) {
+        bibw_options.output = BIBW_OUTPUT_TEXT;
+    } else if (0 == strcmp(arg, "json")) {
+        bibw_options.output = BIBW_OUTPUT_JSON;
+    } else if (0 == strcmp(arg, "csv")) {
+        bibw_options.output = BIBW_OUTPUT_CSV;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_output_file(const char *arg)
+{
+    if ('\0' == *arg || strlen(arg) >= BIBW_PATH_LEN) {
+        return -1;
+    }
+    strcpy(bibw_options.output_file, arg);
+    return 0;
+}
+
+static int parse_phases(const char *arg)
+{
+    if (0 == strcmp(arg, "off")) {
+        bibw_options.phases = 0;
+    } else if (0 == strcmp(arg, "on")) {
+        bibw_options.phases = 1;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_overlap_kernel(const char *arg)
+{
+    if (0 == strcmp(arg, "triad")) {
+        bibw_options.overlap_kernel = BIBW_KERNEL_TRIAD;
+    } else if (0 == strcmp(arg, "matvec")) {
+        bibw_options.overlap_kernel = BIBW_KERNEL_MATVEC;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Unlike BIBW_OPT_INT, 0 is valid here: never poke */
+static int parse_overlap_poke(const char *arg)
+{
+    char *end = NULL;
+    long value = strtol(arg, &end, 10);
+
+    if (end == arg || '\0' != *end || value < 0) {
+        return -1;
+    }
+    bibw_options.overlap_poke = (int)value;
+    return 0;
+}
+
+/* Comma-separated non-negative integers, at most BIBW_MAX_BIND */
+static int parse_int_list(const char *arg, int *values, int *n)
+{
+    char list[256], *tok = NULL, *save = NULL, *end = NULL;
+    long value = 0;
+
+    if (strlen(arg) >= sizeof(list)) {
+        return -1;
+    }
+    strcpy(list, arg);
+    *n = 0;
+    for (tok = strtok_r(list, ",", &save); NULL != tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        value = strtol(tok, &end, 10);
+        if (end == tok || '\0' != *end || value < 0 ||
+            BIBW_MAX_BIND == *n) {
+            return -1;
+        }
+        values[(*n)++] = (int)value;
+    }
+    return *n > 0 ? 0 : -1;
+}
+
+static int parse_bind(const char *arg)
+{
+    return parse_int_list(arg, bibw_options.bind_cpus,
+                          &bibw_options.num_bind_cpus);
+}
+
+static int parse_membind(const char *arg)
+{
+    if (0 == strcmp(arg, "off")) {
+        bibw_options.membind = BIBW_MEMBIND_OFF;
+    } else if (0 == strcmp(arg, "local")) {
+        bibw_options.membind = BIBW_MEMBIND_LOCAL;
+    } else if (0 == strcmp(arg, "remote")) {
+        bibw_options.membind = BIBW_MEMBIND_REMOTE;
+    } else if (0 == parse_int_list(arg, bibw_options.mem_nodes,
+                                   &bibw_options.num_mem_nodes)) {
+        bibw_options.membind = BIBW_MEMBIND_NODES;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_validator(const char *arg)
+{
+    if (0 == strcmp(arg, "omb")) {
+        bibw_options.validator = BIBW_VALIDATOR_OMB;
+    } else if (0 == strcmp(arg, "compare")) {
+        bibw_options.validator = BIBW_VALIDATOR_COMPARE;
+    } else if (0 == strcmp(arg, "crc32c")) {
+        bibw_options.validator = BIBW_VALIDATOR_CRC32C;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* 0 is valid here: whole buffers */
+static int parse_validate_slices(const char *arg)
+{
+    char *end = NULL;
+    long value = strtol(arg, &end, 10);
+
+    if (end == arg || '\0' != *end || value < 0) {
+        return -1;
+    }
+    bibw_options.validate_slices = (int)value;
+    return 0;
+}
+
+static int parse_ddt_layout(const char *arg)
+{
+    if (0 == strcmp(arg, "vector")) {
+        bibw_options.ddt_layout = BIBW_DDT_VECTOR;
+    } else if (0 == strcmp(arg, "indexed")) {
+        bibw_options.ddt_layout = BIBW_DDT_INDEXED;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_stream_depth(const char *arg)
+{
+    char *end = NULL;
+    long value = strtol(arg, &end, 10);
+
+    if (end == arg || '\0' != *end || value < 0) {
+        return -1;
+    }
+    bibw_options.stream_depth = (int)value;
+    return 0;
+}
+
+static int parse_stream_completion(const char *arg)
+{
+    if (0 == strcmp(arg, "waitsome")) {
+        bibw_options.stream_completion = BIBW_STREAM_WAITSOME;
+    } else if (0 == strcmp(arg, "testsome")) {
+        bibw_options.stream_completion = BIBW_STREAM_TESTSOME;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_load(const char *arg)
+{
+    if (0 == strcmp(arg, "bulk")) {
+        bibw_options.load = BIBW_LOAD_BULK;
+    } else if (0 == strcmp(arg, "flood")) {
+        bibw_options.load = BIBW_LOAD_FLOOD;
+    } else if (0 == strcmp(arg, "alltoall")) {
+        bibw_options.load = BIBW_LOAD_ALLTOALL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_load_source(const char *arg)
+{
+    if (0 == strcmp(arg, "ranks")) {
+        bibw_options.load_source = BIBW_LOAD_RANKS;
+    } else if (0 == strcmp(arg, "thread")) {
+        bibw_options.load_source = BIBW_LOAD_THREAD;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_load_size(const char *arg)
+{
+    char *end = NULL;
+    long value = strtol(arg, &end, 10);
+
+    if (end == arg || '\0' != *end || value < 0) {
+        return -1;
+    }
+    bibw_options.load_size = (int)value;
+    return 0;
+}
+
+/* Comma-separated MB/s, 0 idle and max unthrottled */
+static int parse_load_rates(const char *arg)
+{
+    char list[256], *tok = NULL, *save = NULL, *end = NULL;
+    double value = 0.0;
+    int n = 0;
+
+    if (strlen(arg) >= sizeof(list)) {
+        return -1;
+    }
+    strcpy(list, arg);
+    for (tok = strtok_r(list, ",", &save); NULL != tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (BIBW_MAX_LOAD_LEVELS == n) {
+            return -1;
+        }
+        if (0 == strcmp(tok, "max")) {
+            value = BIBW_LOAD_UNTHROTTLED;
+        } else {
+            value = strtod(tok, &end);
+            if (end == tok || '\0' != *end || value < 0.0) {
+                return -1;
+            }
+        }
+        bibw_options.load_rates[n++] = value;
+    }
+    if (0 == n) {
+        return -1;
+    }
+    bibw_options.num_load_rates = n;
+    return 0;
+}
+
+static const struct bibw_opt_t bibw_opts[] = {
+    {"statsd", BIBW_OPT_CUSTOM, NULL, parse_statsd, "HOST[:PORT]|off",
+     "StatsD endpoint for telemetry (default 127.0.0.1:8125)"},
+    {"statsd-mtu", BIBW_OPT_INT, &bibw_options.statsd_mtu, NULL, "BYTES",
+     "link MTU used to size telemetry datagrams (default 1500)"},
+    {"mode", BIBW_OPT_CUSTOM, NULL, parse_mode, "NAME",
+     "run an alternative measurement mode instead of the size sweep"},
+    {"rounds", BIBW_OPT_INT, &bibw_options.rounds, NULL, "N",
+     "interleaved rounds per size in comparison modes (default 10)"},
+    {"engines", BIBW_OPT_CUSTOM, NULL, parse_engines, "LIST",
+     "extra window engines reported next to isend, comma separated"},
+    {"partitions", BIBW_OPT_INT, &bibw_options.partitions, NULL, "N",
+     "partitions per message for the partitioned engine (default 4)"},
+    {"arena", BIBW_OPT_CUSTOM, NULL, parse_arena, "on|huge|off",
+     "-b multiple buffers from one pre-faulted arena (default on)"},
+    {"pairing", BIBW_OPT_CUSTOM, NULL, parse_pairing,
+     "block|cyclic|cross-node", "how --mode=pairs pairs ranks (default block)"},
+    {"threads", BIBW_OPT_INT, &bibw_options.threads, NULL, "T",
+     "largest thread count for --mode=threads (default: online cores)"},
+    {"thread-window", BIBW_OPT_CUSTOM, NULL, parse_thread_window,
+     "slice|full", "threads split one window or each post a full one"},
+    {"sweep-threshold", BIBW_OPT_DOUBLE, &bibw_options.sweep_threshold, NULL,
+     "PCT", "bandwidth drop that --mode=sweep treats as a cliff (default 10)"},
+    {"sweep-resolution", BIBW_OPT_INT, &bibw_options.sweep_resolution, NULL,
+     "BYTES", "size resolution --mode=sweep bisects down to (default 256)"},
+    {"tune-max-window", BIBW_OPT_INT, &bibw_options.tune_max_window, NULL,
+     "N", "deepest window --mode=tune tries (default 256)"},
+    {"tune-memory", BIBW_OPT_INT, &bibw_options.tune_memory, NULL, "MB",
+     "buffer budget per rank that caps --mode=tune depths (default 256)"},
+    {"tune-budget", BIBW_OPT_DOUBLE, &bibw_options.tune_budget, NULL, "SEC",
+     "search time per size for --mode=tune (default 2)"},
+    {"tune-flat", BIBW_OPT_DOUBLE, &bibw_options.tune_flat, NULL, "PCT",
+     "distance from peak that counts as flattened (default 5)"},
+    {"ci-target", BIBW_OPT_DOUBLE, &bibw_options.ci_target, NULL, "PCT",
+     "relative 95% CI half-width --mode=converge stops at (default 1)"},
+    {"ci-max-time", BIBW_OPT_DOUBLE, &bibw_options.ci_max_time, NULL, "SEC",
+     "time cap per size for --mode=converge (default 5)"},
+    {"ci-batch", BIBW_OPT_INT, &bibw_options.ci_batch, NULL, "N",
+     "windows between convergence checks (default 10)"},
+    {"output", BIBW_OPT_CUSTOM, NULL, parse_output, "text|json|csv",
+     "also write structured results (JSON Lines or CSV)"},
+    {"output-file", BIBW_OPT_CUSTOM, NULL, parse_output_file, "PATH",
+     "structured result file (default osu_bibw.jsonl / .csv)"},
+    {"phases", BIBW_OPT_CUSTOM, NULL, parse_phases, "on|off",
+     "split each timed window into post/wait phases on both ranks"},
+    {"overlap-kernel", BIBW_OPT_CUSTOM, NULL, parse_overlap_kernel,
+     "triad|matvec", "compute kernel for --mode=overlap (default triad)"},
+    {"overlap-compute", BIBW_OPT_DOUBLE, &bibw_options.overlap_compute, NULL,
+     "PCT", "kernel time per window, % of the comm time (default 100)"},
+    {"overlap-poke", BIBW_OPT_CUSTOM, NULL, parse_overlap_poke, "N",
+     "kernel blocks between MPI_Testall calls, 0 never (default 8)"},
+    {"shm-nt", BIBW_OPT_INT, &bibw_options.shm_nt, NULL, "BYTES",
+     "--mode=shm copies this large use non-temporal stores (default 256K)"},
+    {"bind", BIBW_OPT_CUSTOM, NULL, parse_bind, "CPU[,CPU...]",
+     "pin rank r and its threads to the r-th listed CPU"},
+    {"membind", BIBW_OPT_CUSTOM, NULL, parse_membind,
+     "local|remote|NODE[,...]", "NUMA node the buffers are first touched on"},
+    {"validator", BIBW_OPT_CUSTOM, NULL, parse_validator,
+     "omb|compare|crc32c", "how -c fills and checks buffers (default omb)"},
+    {"validate-every", BIBW_OPT_INT, &bibw_options.validate_every, NULL, "N",
+     "-c checks every Nth timed window (compare/crc32c, default 1)"},
+    {"validate-slices", BIBW_OPT_CUSTOM, NULL, parse_validate_slices, "K",
+     "-c checks K random 4 KiB slices per buffer, 0 all (default 0)"},
+    {"ddt-layout", BIBW_OPT_CUSTOM, NULL, parse_ddt_layout, "vector|indexed",
+     "message layout for --mode=ddt (default vector)"},
+    {"ddt-block", BIBW_OPT_INT, &bibw_options.ddt_block, NULL, "N",
+     "doubles per block for --mode=ddt (default 8)"},
+    {"ddt-stride", BIBW_OPT_INT, &bibw_options.ddt_stride, NULL, "N",
+     "doubles between block starts, at least 2 blocks (default 16)"},
+    {"ddt-chunks", BIBW_OPT_INT, &bibw_options.ddt_chunks, NULL, "N",
+     "pipeline chunks per message for --mode=ddt (default 4)"},
+    {"stream-bytes", BIBW_OPT_INT, &bibw_options.stream_bytes, NULL, "BYTES",
+     "bytes per direction and size for --mode=stream (default 64 MiB)"},
+    {"stream-depth", BIBW_OPT_CUSTOM, NULL, parse_stream_depth, "N",
+     "messages in flight per direction, 0 uses -W (default 0)"},
+    {"stream-completion", BIBW_OPT_CUSTOM, NULL, parse_stream_completion,
+     "waitsome|testsome",
+     "how --mode=stream reaps requests (default waitsome)"},
+    {"load", BIBW_OPT_CUSTOM, NULL, parse_load, "bulk|flood|alltoall",
+     "background traffic shape for --mode=contention (default bulk)"},
+    {"load-source", BIBW_OPT_CUSTOM, NULL, parse_load_source, "ranks|thread",
+     "extra ranks or a thread per rank generate the load (default ranks)"},
+    {"load-size", BIBW_OPT_CUSTOM, NULL, parse_load_size, "BYTES",
+     "background message size, 0 picks one per shape (default 0)"},
+    {"load-rates", BIBW_OPT_CUSTOM, NULL, parse_load_rates, "MBPS[,...]",
+     "load levels per generator, 0 idle, max unthrottled (default "
+     "0,100,1000,max)"},
+};
+
+#define BIBW_NUM_OPTS (sizeof(bibw_opts) / sizeof(bibw_opts[0]))
+
+static int apply_option(const struct bibw_opt_t *opt, const char *arg)
+{
+    char *end = NULL;
+    long value = 0;
+
+    switch (opt->kind) {
+        case BIBW_OPT_INT:
+            value = strtol(arg, &end, 10);
+            if (end == arg || '\0' != *end || value <= 0) {
+                return -1;
+            }
+            *(int *)opt->dest = (int)value;
+            return 0;
+        case BIBW_OPT_DOUBLE:
+            *(double *)opt->dest = strtod(arg, &end);
+            if (end == arg || '\0' != *end || *(double *)opt->dest <= 0.0) {
+                return -1;
+            }
+            return 0;
+        case BIBW_OPT_CUSTOM:
+            return opt->parse(arg);
+    }
+    return -1;
+}
+
+/*
+ * omb_mpi_init() initialises with MPI_Init. Modes that drive MPI from
+ * several threads initialise here instead, with the level they need; a
+ * library that cannot provide it is reported by the mode itself.
+ */
+omb_mpi_init_data bibw_mpi_init(int *argc, char ***argv)
+{
+    omb_mpi_init_data init_h;
+    int provided = 0;
+
+    if (NULL == bibw_options.mode ||
+        MPI_THREAD_SINGLE == bibw_options.mode->thread_level) {
+        return omb_mpi_init(argc, argv);
+    }
+    memset(&init_h, 0, sizeof(init_h));
+    MPI_CHECK(MPI_Init_thread(argc, argv, bibw_options.mode->thread_level,
+                              &provided));
+    init_h.omb_comm = MPI_COMM_WORLD;
+
+    return init_h;
+}
+
+/*
+ * Consume every recognised --name=VALUE / --name VALUE pair from argv and
+ * compact the remainder in place. Unrecognised arguments are left for the
+ * OMB parser.
+ */
+int bibw_process_options(int *argc, char *argv[])
+{
+    int in = 1, out = 1;
+    int ret = PO_OKAY;
+    size_t i = 0, len = 0;
+    const char *arg = NULL;
+
+    while (in < *argc) {
+        const struct bibw_opt_t *opt = NULL;
+
+        if (0 != strncmp(argv[in], "--", 2)) {
+            argv[out++] = argv[in++];
+            continue;
+        }
+        for (i = 0; i < BIBW_NUM_OPTS; i++) {
+            len = strlen(bibw_opts[i].name);
+            if (0 == strncmp(argv[in] + 2, bibw_opts[i].name, len) &&
+                ('\0' == argv[in][2 + len] || '=' == argv[in][2 + len])) {
+                opt = &bibw_opts[i];
+                break;
+            }
+        }
+        if (NULL == opt) {
+            argv[out++] = argv[in++];
+            continue;
+        }
+        if ('=' == argv[in][2 + len]) {
+            arg = argv[in] + 3 + len;
+            in++;
+        } else if (in + 1 < *argc) {
+            arg = argv[in + 1];
+            in += 2;
+        } else {
+            fprintf(stderr, "Option --%s requires an argument\n", opt->name);
+            ret = PO_BAD_USAGE;
+            in++;
+            continue;
+        }
+        if (apply_option(opt, arg)) {
+            fprintf(stderr, "Invalid value '%s' for --%s\n", arg, opt->name);
+            ret = PO_BAD_USAGE;
+        }
+    }
+    argv[out] = NULL;
+    *argc = out;
+
+    if (BIBW_OUTPUT_TEXT != bibw_options.output &&
+        NULL != bibw_options.mode && !bibw_options.mode->results) {
+        fprintf(stderr, "--mode=%s writes no result records, --output=json|csv "
+                        "is not supported with it\n",
+                bibw_options.mode->name);
+        ret = PO_BAD_USAGE;
+    }
+
+    return ret;
+}
+
+void bibw_print_help_message(int rank)
+{
+    size_t i = 0;
+    char lhs[64];
+
+    if (0 != rank) {
+        return;
+    }
+    fprintf(stdout, "\nExtended options:\n");
+    for (i = 0; i < BIBW_NUM_OPTS; i++) {
+        snprintf(lhs, sizeof(lhs), "--%s=%s", bibw_opts[i].name,
+                 bibw_opts[i].arg_name);
+        fprintf(stdout, "  %-28s %s\n", lhs, bibw_opts[i].help);
+    }
+    fprintf(stdout, "\nModes (--mode=NAME):\n");
+    for (i = 0; i < BIBW_NUM_MODES; i++) {
+        fprintf(stdout, "  %-28s %s\n", bibw_modes[i].name, bibw_modes[i].help);
+    }
+    fprintf(stdout, "\nEngines (--engines=LIST): ");
+    bibw_engine_list(stdout);
+    fprintf(stdout, "\n");
+    fflush(stdout);
+}
@@ -0,0 +1,303 @@
+/*
+ * Structured result output.
+ *
+ * JSON Lines: the first line is a "run" object with the metadata needed
+ * to tell two result files apart (MPI library, hosts, window, iteration
+ * counts, engines), every further line a "result" object. CSV carries the
+ * same metadata as leading "# key: value" comment lines, followed by one
+ * header row and one row per result. Null-call costs from --mode=calls
+ * are "call" objects in JSON Lines and "# call.NAME_ns: MEAN" lines in
+ * CSV. osu_bibw_matched.py writes the same format from mpi4py, and
+ * bibw_compare.py reads both, as well as the plain text tables.
+ */
+#include "bibw.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static FILE *out = NULL;
+
+static const char *const csv_columns =
+    "size,datatype,engine,window,iterations,bandwidth_mbs,samples,mean_mbs,"
+    "median_mbs,stddev_mbs,ci95_mbs";
+
+static void json_string(const char *s)
+{
+    fputc('"', out);
+    for (; '\0' != *s; s++) {
+        if ('"' == *s || '\\' == *s) {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* A number, or null / an empty CSV field when it is not finite */
+static void number(double x)
+{
+    if (isfinite(x)) {
+        fprintf(out, "%.6f", x);
+    } else if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fprintf(out, "null");
+    }
+}
+
+/* One metadata entry; list entries are written comma separated */
+static void meta_begin(const char *key, int first)
+{
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fprintf(out, "%s\"%s\": ", first ? "" : ", ", key);
+    } else {
+        fprintf(out, "# %s: ", key);
+    }
+}
+
+static void meta_end(void)
+{
+    if (BIBW_OUTPUT_CSV == bibw_options.output) {
+        fputc('\n', out);
+    }
+}
+
+static void meta_string(const char *key, const char *value)
+{
+    meta_begin(key, 0);
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        json_string(value);
+    } else {
+        fputs(value, out);
+    }
+    meta_end();
+}
+
+static void meta_int(const char *key, long value)
+{
+    meta_begin(key, 0);
+    fprintf(out, "%ld", value);
+    meta_end();
+}
+
+static void meta_list(const char *key, const char *const *values, int n)
+{
+    int i = 0;
+
+    meta_begin(key, 0);
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fputc('[', out);
+    }
+    for (i = 0; i < n; i++) {
+        if (i > 0) {
+            fputs(BIBW_OUTPUT_JSON == bibw_options.output ? ", " : ",", out);
+        }
+        if (BIBW_OUTPUT_JSON == bibw_options.output) {
+            json_string(values[i]);
+        } else {
+            fputs(values[i], out);
+        }
+    }
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fputc(']', out);
+    }
+    meta_end();
+}
+
+static const char *arena_name(void)
+{
+    switch (bibw_options.arena) {
+        case BIBW_ARENA_PAGES:
+            return "on";
+        case BIBW_ARENA_HUGE:
+            return "huge";
+    }
+    return "off";
+}
+
+static void write_metadata(const char *hosts, int numprocs)
+{
+    char library[MPI_MAX_LIBRARY_VERSION_STRING];
+    char version[16], stamp[32];
+    const char *names[BIBW_MAX_ENGINES + 1];
+    const char **host_list = NULL;
+    time_t now = time(NULL);
+    int len = 0, major = 0, minor = 0, i = 0;
+
+    MPI_CHECK(MPI_Get_library_version(library, &len));
+    /* Keep the first line: some libraries append build details */
+    library[strcspn(library, "\n")] = '\0';
+    MPI_CHECK(MPI_Get_version(&major, &minor));
+    snprintf(version, sizeof(version), "%d.%d", major, minor);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    host_list = malloc(sizeof(char *) * numprocs);
+    OMB_CHECK_NULL_AND_EXIT(host_list, "Unable to allocate memory");
+    for (i = 0; i < numprocs; i++) {
+        host_list[i] = hosts + (size_t)i * MPI_MAX_PROCESSOR_NAME;
+    }
+    names[0] = bibw_engine_isend.name;
+    for (i = 0; i < bibw_options.num_engines; i++) {
+        names[i + 1] = bibw_options.engines[i]->name;
+    }
+
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fprintf(out, "{");
+        meta_begin("type", 1);
+        json_string("run");
+    }
+    meta_string("benchmark", "osu_bibw");
+    meta_string("implementation", "c");
+    meta_string("mode", bibw_options.mode ? bibw_options.mode->name : "bibw");
+    meta_string("timestamp", stamp);
+    meta_string("mpi_library", library);
+    meta_string("mpi_version", version);
+    meta_int("nprocs", numprocs);
+    meta_list("hosts", host_list, numprocs);
+    meta_int("window", options.window_size);
+    meta_int("iterations", options.iterations);
+    meta_int("iterations_large", options.iterations_large);
+    meta_int("skip", options.skip);
+    meta_int("skip_large", options.skip_large);
+    meta_int("min_size", (long)options.min_message_size);
+    meta_int("max_size", (long)options.max_message_size);
+    meta_string("buffers", MULTIPLE == options.buf_num ? "multiple" : "single");
+    meta_string("arena", arena_name());
+    meta_list("engines", names, bibw_options.num_engines + 1);
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fprintf(out, "}\n");
+    } else {
+        fprintf(out, "%s\n", csv_columns);
+    }
+    fflush(out);
+    free(host_list);
+}
+
+int bibw_output_open(MPI_Comm comm, int rank, int numprocs)
+{
+    char name[MPI_MAX_PROCESSOR_NAME];
+    char *hosts = NULL;
+    const char *path = bibw_options.output_file;
+    int len = 0, failed = 0;
+
+    if (BIBW_OUTPUT_TEXT == bibw_options.output) {
+        return 0;
+    }
+    memset(name, 0, sizeof(name));
+    MPI_CHECK(MPI_Get_processor_name(name, &len));
+    if (0 == rank) {
+        hosts = malloc((size_t)numprocs * MPI_MAX_PROCESSOR_NAME);
+        OMB_CHECK_NULL_AND_EXIT(hosts, "Unable to allocate memory");
+    }
+    MPI_CHECK(MPI_Gather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, hosts,
+                         MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, comm));
+
+    if (0 == rank) {
+        if ('\0' == *path) {
+            path = BIBW_OUTPUT_JSON == bibw_options.output ? "osu_bibw.jsonl"
+                                                           : "osu_bibw.csv";
+        }
+        out = fopen(path, "w");
+        if (NULL == out) {
+            fprintf(stderr, "Unable to open result file %s\n", path);
+            failed = 1;
+        } else {
+            write_metadata(hosts, numprocs);
+        }
+        free(hosts);
+    }
+    MPI_CHECK(MPI_Bcast(&failed, 1, MPI_INT, 0, comm));
+
+    return failed ? -1 : 0;
+}
+
+int bibw_output_enabled(void)
+{
+    return NULL != out;
+}
+
+void bibw_output_result(const struct bibw_result_t *r)
+{
+    struct bibw_stats_t *st = r->windows;
+    size_t n = st ? st->n : 0;
+    double mean = NAN, median = NAN, stddev = NAN, ci = NAN;
+
+    if (NULL == out) {
+        return;
+    }
+    if (n > 0) {
+        mean = st->mean;
+        median = bibw_stats_median(st);
+        stddev = bibw_stats_stddev(st);
+        ci = bibw_stats_ci95(st);
+    }
+
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fprintf(out, "{\"type\": \"result\", \"size\": %zu, \"datatype\": ",
+                r->size);
+        json_string(r->datatype);
+        fprintf(out, ", \"engine\": ");
+        json_string(r->engine);
+        fprintf(out, ", \"window\": %d, \"iterations\": %d, "
+                     "\"bandwidth_mbs\": ",
+                r->window, r->iterations);
+        number(r->bandwidth);
+        fprintf(out, ", \"samples\": %zu, \"mean_mbs\": ", n);
+        number(mean);
+        fprintf(out, ", \"median_mbs\": ");
+        number(median);
+        fprintf(out, ", \"stddev_mbs\": ");
+        number(stddev);
+        fprintf(out, ", \"ci95_mbs\": ");
+        number(ci);
+        fprintf(out, "}\n");
+    } else {
+        fprintf(out, "%zu,%s,%s,%d,%d,", r->size, r->datatype, r->engine,
+                r->window, r->iterations);
+        number(r->bandwidth);
+        fprintf(out, ",%zu,", n);
+        number(mean);
+        fputc(',', out);
+        number(median);
+        fputc(',', out);
+        number(stddev);
+        fputc(',', out);
+        number(ci);
+        fputc('\n', out);
+    }
+    fflush(out);
+}
+
+void bibw_output_call(const char *call, struct bibw_stats_t *ns)
+{
+    if (NULL == out) {
+        return;
+    }
+    if (BIBW_OUTPUT_JSON == bibw_options.output) {
+        fprintf(out, "{\"type\": \"call\", \"call\": ");
+        json_string(call);
+        fprintf(out, ", \"samples\": %zu, \"mean_ns\": ", ns->n);
+        number(ns->mean);
+        fprintf(out, ", \"median_ns\": ");
+        number(bibw_stats_median(ns));
+        fprintf(out, ", \"stddev_ns\": ");
+        number(bibw_stats_stddev(ns));
+        fprintf(out, "}\n");
+    } else {
+        fprintf(out, "# call.%s_ns: ", call);
+        number(ns->mean);
+        fputc('\n', out);
+    }
+    fflush(out);
+}
+
+void bibw_output_close(void)
+{
+    if (NULL != out) {
+        fclose(out);
+        out = NULL;
+    }
+}
@@ -0,0 +1,173 @@
+/*
+ * --mode=telemetry-overhead
+ *
+ * Runs the regular window exchange with and without the telemetry the
+ * size sweep in main() sends, and reports its bandwidth cost against
+ * run-to-run noise:
+ *
+ *   off        no metric recorded or emitted
+ *   telemetry  every timed window recorded in the log-linear histogram
+ *              on rank 0, and per size the histogram quantiles and the
+ *              bandwidth queued for the sender thread
+ *
+ * As in main(), where one size's metrics are shipped while the next size
+ * runs, each telemetry batch emits the previous batch's metrics just
+ * before its timed windows, so the sender thread works during them.
+ * Metrics carry a mode:telemetry-overhead tag to keep them apart from real
+ * runs.
+ *
+ * The configurations are interleaved round by round, with the order rotated
+ * each round, so slow drift in the container affects all of them equally.
+ */
+#include "bibw.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { CFG_OFF, CFG_TELEMETRY, NUM_CFGS };
+
+struct telemetry_state {
+    struct bibw_hist_t *hist;         /* windows of the last batch */
+    double bandwidth;                 /* bytes/s of the last batch */
+    char tags[BIBW_METRIC_TAGS_LEN];
+};
+
+static double timed_batch(struct bibw_window_t *w, int cfg,
+                          struct telemetry_state *ts, double mb,
+                          int iterations, int skip)
+{
+    double t_start = 0.0, t_total = 0.0, t = 0.0;
+    int record = CFG_TELEMETRY == cfg && 0 == w->rank;
+    int i = 0;
+
+    if (record) {
+        if (ts->hist->count > 0) {
+            bibw_hist_emit(ts->hist, "mpi_benchmark.window", ts->tags);
+            bibw_telemetry_emit("mpi_benchmark.bandwidth", ts->bandwidth, "h",
+                                ts->tags);
+        }
+        bibw_hist_reset(ts->hist);
+    }
+    MPI_CHECK(MPI_Barrier(w->comm));
+    for (i = 0; i < iterations + skip; i++) {
+        t_start = MPI_Wtime();
+        bibw_window_exchange(w);
+        if (i < skip) {
+            continue;
+        }
+        t = MPI_Wtime() - t_start;
+        t_total += t;
+        if (record) {
+            bibw_hist_record(ts->hist, t);
+        }
+    }
+    if (record) {
+        ts->bandwidth = mb * 1e6 / t_total;
+    }
+    /* The queue must not carry work over into the next configuration */
+    bibw_telemetry_flush();
+
+    return t_total;
+}
+
+int bibw_mode_telemetry_overhead(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_window_t w;
+    struct telemetry_state ts;
+    double sum[NUM_CFGS], sumsq[NUM_CFGS], mean[NUM_CFGS], sd[NUM_CFGS];
+    double mb = 0.0, bw = 0.0, noise = 0.0;
+    int iterations = options.iterations, skip = options.skip;
+    int enabled = bibw_telemetry_enabled();
+    int rounds = bibw_options.rounds;
+    int r = 0, c = 0, cfg = 0;
+    size_t size = 0;
+
+    (void)numprocs;
+    MPI_CHECK(MPI_Bcast(&enabled, 1, MPI_INT, 0, comm));
+    if (!enabled) {
+        if (0 == rank) {
+            fprintf(stderr, "telemetry-overhead mode needs a working StatsD "
+                            "endpoint (see --statsd)\n");
+        }
+        return 1;
+    }
+    if (bibw_window_init(&w, comm, rank, 1 - rank, options.window_size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    ts.hist = malloc(sizeof(struct bibw_hist_t));
+    OMB_CHECK_NULL_AND_EXIT(ts.hist, "Unable to allocate memory");
+
+    if (0 == rank) {
+        fprintf(stdout, "# Telemetry overhead, %d interleaved rounds per size\n",
+                rounds);
+        fprintf(stdout, "%-10s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "Off (MB/s)", FIELD_WIDTH, "Telemetry (MB/s)", FIELD_WIDTH,
+                "Overhead (%)", FIELD_WIDTH, "Noise (%)");
+        fflush(stdout);
+    }
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (bibw_window_set_size(&w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            iterations = options.iterations_large;
+            skip = options.skip_large;
+        }
+        mb = size / 1e6 * iterations * w.window_size * 2;
+        bibw_hist_reset(ts.hist);
+        snprintf(ts.tags, sizeof(ts.tags),
+                 "size:%zu,window:%d,mode:telemetry-overhead", size,
+                 w.window_size);
+        memset(sum, 0, sizeof(sum));
+        memset(sumsq, 0, sizeof(sumsq));
+        for (r = 0; r < rounds; r++) {
+            for (c = 0; c < NUM_CFGS; c++) {
+                cfg = (c + r) % NUM_CFGS;
+                bw = mb / timed_batch(&w, cfg, &ts, mb, iterations, skip);
+                sum[cfg] += bw;
+                sumsq[cfg] += bw * bw;
+            }
+        }
+        if (0 != rank) {
+            continue;
+        }
+        for (cfg = 0; cfg < NUM_CFGS; cfg++) {
+            mean[cfg] = sum[cfg] / rounds;
+            sd[cfg] = rounds > 1 ? sqrt(fmax(0.0, (sumsq[cfg] -
+                                                   rounds * mean[cfg] *
+                                                       mean[cfg]) /
+                                                      (rounds - 1)))
+                                 : 0.0;
+        }
+        /* ~95% half-width of the off/telemetry difference, relative to off */
+        noise = 2.0 *
+                sqrt((sd[CFG_OFF] * sd[CFG_OFF] +
+                      sd[CFG_TELEMETRY] * sd[CFG_TELEMETRY]) /
+                     rounds) /
+                mean[CFG_OFF] * 100.0;
+        fprintf(stdout, "%-*zu", 10, size);
+        for (cfg = 0; cfg < NUM_CFGS; cfg++) {
+            fprintf(stdout, "%*.*f", FIELD_WIDTH, FLOAT_PRECISION, mean[cfg]);
+        }
+        fprintf(stdout, "%*.*f%*.*f%s\n", FIELD_WIDTH, FLOAT_PRECISION,
+                (mean[CFG_OFF] - mean[CFG_TELEMETRY]) / mean[CFG_OFF] * 100.0,
+                FIELD_WIDTH, FLOAT_PRECISION, noise,
+                fabs(mean[CFG_OFF] - mean[CFG_TELEMETRY]) / mean[CFG_OFF] *
+                            100.0 <=
+                        noise
+                    ? ""
+                    : "  *");
+        fflush(stdout);
+    }
+    if (0 == rank) {
+        fprintf(stdout, "# '*' marks sizes where the telemetry overhead "
+                        "exceeds the noise band\n");
+    }
+
+    free(ts.hist);
+    bibw_window_free(&w);
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * --mode=overlap
+ *
+ * Whether the MPI library moves data while the application computes. Per
+ * message size three things are timed, each per window:
+ *
+ *   comm         the window exchange alone
+ *   compute      the kernel alone, sized to --overlap-compute percent of
+ *                rank 0's comm time (both ranks calibrate at the same
+ *                time and run the smaller block count)
+ *   overlapped   post the window, run the kernel, then MPI_Waitall; every
+ *                --overlap-poke kernel blocks MPI_Testall over the
+ *                window's receives and sends gives the library a chance
+ *                to progress every message still in flight
+ *
+ * The ratio is overlapped / (comm + compute): 1.0 means nothing overlapped,
+ * 0.5 full overlap of equal parts. Overlap (%) is the share of the comm
+ * time hidden behind the kernel, 100 - (overlapped - compute) / comm, as
+ * the OMB non-blocking collective tests report it. Running with
+ * --overlap-poke=0 shows what the library does without being polled.
+ *
+ * Kernels use GCC/Clang vector extensions, so they compile to the widest
+ * SIMD unit the build targets without tying the source to one ISA:
+ *
+ *   triad    a = b + s * c over three vectors that fit in L2
+ *   matvec   y = A x with a dense 256 x 256 matrix, blocked by rows, four
+ *            rows per pass over x
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KERNEL_BLOCKS 32                 /* blocks per pass over the data */
+#define TRIAD_BLOCK 512                  /* doubles per triad block */
+#define TRIAD_N (TRIAD_BLOCK * KERNEL_BLOCKS)
+#define MATVEC_N 256
+#define MATVEC_ROWS (MATVEC_N / KERNEL_BLOCKS)
+#define CALIBRATE_PASSES 64
+
+typedef double v4d __attribute__((vector_size(32)));
+
+struct overlap_state {
+    struct bibw_window_t w;
+    v4d *a, *b, *c;                      /* triad vectors, or A and x */
+    double *y;
+    void (*block)(struct overlap_state *st, int blk);
+};
+
+static void triad_block(struct overlap_state *st, int blk)
+{
+    const v4d s = {3.0, 3.0, 3.0, 3.0};
+    v4d *restrict a = st->a + blk * (TRIAD_BLOCK / 4);
+    const v4d *restrict b = st->b + blk * (TRIAD_BLOCK / 4);
+    const v4d *restrict c = st->c + blk * (TRIAD_BLOCK / 4);
+    int i = 0;
+
+    for (i = 0; i < TRIAD_BLOCK / 4; i++) {
+        a[i] = b[i] + s * c[i];
+    }
+}
+
+/* Four rows at a time, so each x vector loaded feeds four FMAs */
+static void matvec_block(struct overlap_state *st, int blk)
+{
+    const v4d *restrict x = st->b;
+    int r = 0, j = 0;
+
+    for (r = blk * MATVEC_ROWS; r < (blk + 1) * MATVEC_ROWS; r += 4) {
+        const v4d *restrict row = st->a + (size_t)r * (MATVEC_N / 4);
+        v4d acc0 = {0}, acc1 = {0}, acc2 = {0}, acc3 = {0};
+
+        for (j = 0; j < MATVEC_N / 4; j++) {
+            acc0 += row[j] * x[j];
+            acc1 += row[j + MATVEC_N / 4] * x[j];
+            acc2 += row[j + 2 * (MATVEC_N / 4)] * x[j];
+            acc3 += row[j + 3 * (MATVEC_N / 4)] * x[j];
+        }
+        st->y[r] = acc0[0] + acc0[1] + acc0[2] + acc0[3];
+        st->y[r + 1] = acc1[0] + acc1[1] + acc1[2] + acc1[3];
+        st->y[r + 2] = acc2[0] + acc2[1] + acc2[2] + acc2[3];
+        st->y[r + 3] = acc3[0] + acc3[1] + acc3[2] + acc3[3];
+    }
+}
+
+static v4d *alloc_vec(size_t doubles, double value)
+{
+    double *p = aligned_alloc(sizeof(v4d), sizeof(double) * doubles);
+    size_t i = 0;
+
+    OMB_CHECK_NULL_AND_EXIT(p, "Unable to allocate memory");
+    for (i = 0; i < doubles; i++) {
+        p[i] = value + (double)(i % 7) / 8.0;
+    }
+    return (v4d *)p;
+}
+
+static void kernel_init(struct overlap_state *st)
+{
+    if (BIBW_KERNEL_MATVEC == bibw_options.overlap_kernel) {
+        st->a = alloc_vec((size_t)MATVEC_N * MATVEC_N, 0.5);
+        st->b = alloc_vec(MATVEC_N, 1.0);
+        st->y = (double *)alloc_vec(MATVEC_N, 0.0);
+        st->block = matvec_block;
+    } else {
+        st->a = alloc_vec(TRIAD_N, 0.0);
+        st->b = alloc_vec(TRIAD_N, 1.0);
+        st->c = alloc_vec(TRIAD_N, 2.0);
+        st->block = triad_block;
+    }
+}
+
+/* Run nblocks kernel blocks; poke the library if a window is in flight */
+static void compute(struct overlap_state *st, long nblocks, int in_flight)
+{
+    int poke = in_flight ? bibw_options.overlap_poke : 0, flag = 0;
+    long i = 0;
+
+    for (i = 0; i < nblocks; i++) {
+        st->block(st, (int)(i % KERNEL_BLOCKS));
+        if (poke > 0 && 0 == (i + 1) % poke) {
+            MPI_CHECK(MPI_Testall(st->w.window_size, st->w.recv_request,
+                                  &flag, MPI_STATUSES_IGNORE));
+            MPI_CHECK(MPI_Testall(st->w.window_size, st->w.send_request,
+                                  &flag, MPI_STATUSES_IGNORE));
+        }
+    }
+}
+
+/* Blocks that take --overlap-compute percent of t_comm on this rank */
+static long calibrate(struct overlap_state *st, double t_comm)
+{
+    double t_start = MPI_Wtime(), t_block = 0.0;
+    long nblocks = 0;
+
+    compute(st, (long)KERNEL_BLOCKS * CALIBRATE_PASSES, 0);
+    t_block = (MPI_Wtime() - t_start) / (KERNEL_BLOCKS * CALIBRATE_PASSES);
+    nblocks = (long)(t_comm * bibw_options.overlap_compute / 100.0 / t_block);
+    return nblocks > 0 ? nblocks : 1;
+}
+
+int bibw_mode_overlap(MPI_Comm comm, int rank, int numprocs)
+{
+    struct overlap_state st = {0};
+    double t_comm = 0.0, t_comp = 0.0, t_ovl = 0.0, t_start = 0.0;
+    double hidden = 0.0;
+    int iterations = options.iterations, skip = options.skip, i = 0;
+    long nblocks = 0;
+    size_t size = 0;
+
+    (void)numprocs;
+    if (bibw_window_init(&st.w, comm, rank, 1 - rank, options.window_size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    kernel_init(&st);
+    if (0 == rank) {
+        fprintf(stdout, "# Overlap: %s kernel at %.0f%% of the comm time, ",
+                BIBW_KERNEL_MATVEC == bibw_options.overlap_kernel ? "matvec"
+                                                                  : "triad",
+                bibw_options.overlap_compute);
+        if (bibw_options.overlap_poke > 0) {
+            fprintf(stdout, "MPI_Testall every %d blocks\n",
+                    bibw_options.overlap_poke);
+        } else {
+            fprintf(stdout, "no MPI_Testall while computing\n");
+        }
+        fprintf(stdout, "%-10s%*s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "Comm (us)", FIELD_WIDTH, "Compute (us)", FIELD_WIDTH,
+                "Overlapped (us)", FIELD_WIDTH, "Ratio", FIELD_WIDTH,
+                "Overlap (%)");
+        fflush(stdout);
+    }
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (bibw_window_set_size(&st.w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            iterations = options.iterations_large;
+            skip = options.skip_large;
+        }
+
+        t_comm = bibw_window_run(&st.w, iterations, skip) / iterations;
+        MPI_CHECK(MPI_Bcast(&t_comm, 1, MPI_DOUBLE, 0, comm));
+        MPI_CHECK(MPI_Barrier(comm));
+        nblocks = calibrate(&st, t_comm);
+        MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &nblocks, 1, MPI_LONG, MPI_MIN,
+                                comm));
+
+        MPI_CHECK(MPI_Barrier(comm));
+        t_start = MPI_Wtime();
+        for (i = 0; i < iterations; i++) {
+            compute(&st, nblocks, 0);
+        }
+        t_comp = (MPI_Wtime() - t_start) / iterations;
+
+        MPI_CHECK(MPI_Barrier(comm));
+        for (i = 0; i < iterations + skip; i++) {
+            if (i == skip) {
+                t_start = MPI_Wtime();
+            }
+            bibw_window_post(&st.w);
+            compute(&st, nblocks, 1);
+            bibw_window_wait(&st.w);
+        }
+        t_ovl = (MPI_Wtime() - t_start) / iterations;
+
+        if (0 == rank) {
+            hidden = 100.0 - (t_ovl - t_comp) / t_comm * 100.0;
+            hidden = hidden < 0.0 ? 0.0 : (hidden > 100.0 ? 100.0 : hidden);
+            fprintf(stdout, "%-*zu%*.*f%*.*f%*.*f%*.*f%*.*f\n", 10, size,
+                    FIELD_WIDTH, FLOAT_PRECISION, t_comm * 1e6, FIELD_WIDTH,
+                    FLOAT_PRECISION, t_comp * 1e6, FIELD_WIDTH,
+                    FLOAT_PRECISION, t_ovl * 1e6, FIELD_WIDTH,
+                    FLOAT_PRECISION, t_ovl / (t_comm + t_comp), FIELD_WIDTH,
+                    FLOAT_PRECISION, hidden);
+            fflush(stdout);
+        }
+    }
+
+    free(st.a);
+    free(st.b);
+    free(st.c);
+    free(st.y);
+    bibw_window_free(&st.w);
+    return 0;
+}
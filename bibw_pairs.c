@@ -0,0 +1,227 @@
+/*
+ * --mode=pairs
+ *
+ * Several rank pairs run the bi-directional window exchange at the same
+ * time. For every pair count n (1, 2, 4, ... up to all pairs) and message
+ * size the first n pairs exchange concurrently while the rest wait, and
+ * rank 0 reports the aggregate bandwidth together with the slowest and
+ * fastest pair, so the point where a shared node or NIC saturates shows up
+ * as the aggregate flattening while min/max fairness drops.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *bibw_pairing_name(int pairing)
+{
+    switch (pairing) {
+        case BIBW_PAIR_BLOCK:
+            return "block";
+        case BIBW_PAIR_CYCLIC:
+            return "cyclic";
+        case BIBW_PAIR_CROSS_NODE:
+            return "cross-node";
+    }
+    return "unknown";
+}
+
+struct rank_place {
+    int node;   /* world rank of the node leader */
+    int local;  /* rank within the node */
+    int rank;
+};
+
+static int compare_place(const void *a, const void *b)
+{
+    const struct rank_place *x = a, *y = b;
+
+    if (x->local != y->local) {
+        return x->local - y->local;
+    }
+    if (x->node != y->node) {
+        return x->node - y->node;
+    }
+    return x->rank - y->rank;
+}
+
+/*
+ * Build the pair table. Every rank computes the same table from the same
+ * allgathered placement, so no further agreement is needed.
+ *
+ *   block       r <-> r + n/2 (the osu_mbw_mr layout)
+ *   cyclic      2k <-> 2k + 1
+ *   cross-node  ranks ordered by (local rank, node) and paired in order,
+ *               which interleaves nodes so partners differ whenever there
+ *               is another node left to pair with
+ */
+int bibw_pairs_init(struct bibw_pairs_t *p, MPI_Comm comm, int pairing)
+{
+    struct rank_place me, *all = NULL, *order = NULL;
+    MPI_Comm node_comm = MPI_COMM_NULL;
+    int nprocs = 0, rank = 0, r = 0, a = 0, b = 0;
+
+    MPI_CHECK(MPI_Comm_size(comm, &nprocs));
+    MPI_CHECK(MPI_Comm_rank(comm, &rank));
+    memset(p, 0, sizeof(*p));
+    if (nprocs < 2 || 0 != nprocs % 2) {
+        return -1;
+    }
+    p->npairs = nprocs / 2;
+    p->partner = malloc(sizeof(int) * nprocs);
+    p->pair_index = malloc(sizeof(int) * nprocs);
+    all = malloc(sizeof(struct rank_place) * nprocs);
+    order = malloc(sizeof(struct rank_place) * nprocs);
+    if (NULL == p->partner || NULL == p->pair_index || NULL == all ||
+        NULL == order) {
+        return -1;
+    }
+
+    MPI_CHECK(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank,
+                                  MPI_INFO_NULL, &node_comm));
+    MPI_CHECK(MPI_Comm_rank(node_comm, &me.local));
+    me.node = rank;
+    MPI_CHECK(MPI_Bcast(&me.node, 1, MPI_INT, 0, node_comm));
+    me.rank = rank;
+    MPI_CHECK(MPI_Comm_free(&node_comm));
+    MPI_CHECK(MPI_Allgather(&me, 3, MPI_INT, all, 3, MPI_INT, comm));
+    memcpy(order, all, sizeof(struct rank_place) * nprocs);
+    qsort(order, nprocs, sizeof(struct rank_place), compare_place);
+
+    for (r = 0; r < p->npairs; r++) {
+        switch (pairing) {
+            case BIBW_PAIR_BLOCK:
+                a = r;
+                b = r + p->npairs;
+                break;
+            case BIBW_PAIR_CYCLIC:
+                a = 2 * r;
+                b = 2 * r + 1;
+                break;
+            default:
+                a = order[2 * r].rank;
+                b = order[2 * r + 1].rank;
+                break;
+        }
+        p->partner[a] = b;
+        p->partner[b] = a;
+        p->pair_index[a] = r;
+        p->pair_index[b] = r;
+    }
+
+    for (r = 0; r < nprocs; r++) {
+        if (r < p->partner[r] && all[r].node != all[p->partner[r]].node) {
+            p->cross_node++;
+        }
+    }
+    free(all);
+    free(order);
+
+    return 0;
+}
+
+void bibw_pairs_free(struct bibw_pairs_t *p)
+{
+    free(p->partner);
+    free(p->pair_index);
+    memset(p, 0, sizeof(*p));
+}
+
+static void print_header(const struct bibw_pairs_t *p)
+{
+    fprintf(stdout, "# Pairing: %s, %d pairs, %d cross-node\n",
+            bibw_pairing_name(bibw_options.pairing), p->npairs, p->cross_node);
+    fprintf(stdout, "%-8s%-10s%*s%*s%*s%*s%*s\n", "# Pairs", "Size",
+            FIELD_WIDTH, "Aggregate (MB/s)", FIELD_WIDTH, "Per pair (MB/s)",
+            FIELD_WIDTH, "Min pair (MB/s)", FIELD_WIDTH, "Max pair (MB/s)",
+            FIELD_WIDTH, "Fairness");
+    fflush(stdout);
+}
+
+int bibw_mode_pairs(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_pairs_t pairs;
+    struct bibw_window_t w;
+    double *times = NULL;
+    double t = 0.0, t_max = 0.0, bw = 0.0, bw_min = 0.0, bw_max = 0.0;
+    double bw_sum = 0.0, mb = 0.0;
+    char tags[BIBW_METRIC_TAGS_LEN];
+    int iterations = 0, skip = 0, active = 0, npairs = 0, r = 0;
+    size_t size = 0;
+
+    if (bibw_pairs_init(&pairs, comm, bibw_options.pairing)) {
+        if (0 == rank) {
+            fprintf(stderr, "pairs mode needs an even number of processes\n");
+        }
+        return 1;
+    }
+    if (bibw_window_init(&w, comm, rank, pairs.partner[rank],
+                         options.window_size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    times = malloc(sizeof(double) * numprocs);
+    OMB_CHECK_NULL_AND_EXIT(times, "Unable to allocate memory");
+    if (0 == rank) {
+        print_header(&pairs);
+    }
+
+    for (npairs = 1;; npairs = npairs * 2 < pairs.npairs ? npairs * 2
+                                                          : pairs.npairs) {
+        active = pairs.pair_index[rank] < npairs;
+        iterations = options.iterations;
+        skip = options.skip;
+        for (size = options.min_message_size;
+             size <= options.max_message_size; size *= 2) {
+            if (bibw_window_set_size(&w, size)) {
+                OMB_ERROR_EXIT("Unable to allocate window");
+            }
+            if (size > LARGE_MESSAGE_SIZE) {
+                iterations = options.iterations_large;
+                skip = options.skip_large;
+            }
+            MPI_CHECK(MPI_Barrier(comm));
+            t = active ? bibw_window_time(&w, iterations, skip) : 0.0;
+            MPI_CHECK(MPI_Gather(&t, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, 0,
+                                 comm));
+            if (0 != rank) {
+                continue;
+            }
+
+            /* Per pair: bytes both ways over the slower of its two ranks */
+            mb = size / 1e6 * iterations * w.window_size * 2;
+            t_max = bw_sum = bw_max = 0.0;
+            bw_min = -1.0;
+            for (r = 0; r < numprocs; r++) {
+                if (pairs.pair_index[r] >= npairs || r > pairs.partner[r]) {
+                    continue;
+                }
+                t = times[r] > times[pairs.partner[r]]
+                        ? times[r]
+                        : times[pairs.partner[r]];
+                bw = mb / t;
+                bw_sum += bw;
+                bw_min = bw_min < 0.0 || bw < bw_min ? bw : bw_min;
+                bw_max = bw > bw_max ? bw : bw_max;
+                t_max = t > t_max ? t : t_max;
+            }
+            fprintf(stdout, "%-8d%-10zu%*.*f%*.*f%*.*f%*.*f%*.*f\n", npairs,
+                    size, FIELD_WIDTH, FLOAT_PRECISION, mb * npairs / t_max,
+                    FIELD_WIDTH, FLOAT_PRECISION, bw_sum / npairs, FIELD_WIDTH,
+                    FLOAT_PRECISION, bw_min, FIELD_WIDTH, FLOAT_PRECISION,
+                    bw_max, FIELD_WIDTH, FLOAT_PRECISION, bw_min / bw_max);
+            fflush(stdout);
+            snprintf(tags, sizeof(tags), "size:%zu,pairs:%d,pairing:%s", size,
+                     npairs, bibw_pairing_name(bibw_options.pairing));
+            bibw_telemetry_emit("mpi_benchmark.pairs.bandwidth",
+                                mb * npairs / t_max * 1e6, "h", tags);
+        }
+        if (npairs == pairs.npairs) {
+            break;
+        }
+    }
+
+    free(times);
+    bibw_window_free(&w);
+    bibw_pairs_free(&pairs);
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Clock calibration and per-size reporting for the window phase timers.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if BIBW_HAVE_TSC
+#include <cpuid.h>
+#endif
+
+#define BIBW_CALIBRATE_NS 20000000L
+
+static const char *const phase_names[BIBW_NUM_PHASES] = {
+    "post_recv",
+    "post_send",
+    "wait_send",
+    "wait_recv",
+};
+
+int bibw_clock_tsc = 0;
+static double ns_per_tick = 1.0;
+static char clock_name[48] = "clock_gettime";
+
+static uint64_t raw_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Use the TSC only when CPUID advertises it as invariant (constant rate
+ * across P-states, ticking through C-states); the rate is taken from a
+ * short sleep bracketed by both clocks.
+ */
+void bibw_clock_init(void)
+{
+#if BIBW_HAVE_TSC
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    struct timespec pause = {0, BIBW_CALIBRATE_NS};
+    uint64_t ns0 = 0, ns1 = 0, tsc0 = 0, tsc1 = 0;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+        !(edx & (1U << 8))) {
+        return;
+    }
+    ns0 = raw_ns();
+    tsc0 = __rdtsc();
+    nanosleep(&pause, NULL);
+    ns1 = raw_ns();
+    tsc1 = __rdtsc();
+    if (tsc1 <= tsc0 || ns1 <= ns0) {
+        return;
+    }
+    ns_per_tick = (double)(ns1 - ns0) / (double)(tsc1 - tsc0);
+    bibw_clock_tsc = 1;
+    snprintf(clock_name, sizeof(clock_name), "TSC at %.3f GHz",
+             1.0 / ns_per_tick);
+#endif
+}
+
+const char *bibw_clock_name(void)
+{
+    return clock_name;
+}
+
+void bibw_phases_reset(struct bibw_phases_t *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+/*
+ * Collective: every rank contributes its mean time per window and phase,
+ * rank 0 prints one comment line per rank below the size's row and emits
+ * the phases as StatsD timers.
+ */
+void bibw_phases_report(const struct bibw_phases_t *p, MPI_Comm comm,
+                        int rank, int numprocs, size_t size)
+{
+    double mine[BIBW_NUM_PHASES], *all = NULL, total = 0.0;
+    char name[BIBW_METRIC_NAME_LEN], tags[BIBW_METRIC_TAGS_LEN];
+    int r = 0, ph = 0;
+
+    if (!bibw_options.phases) {
+        return;
+    }
+    for (ph = 0; ph < BIBW_NUM_PHASES; ph++) {
+        mine[ph] = p->windows > 0
+                       ? p->ticks[ph] * ns_per_tick / p->windows / 1e3
+                       : 0.0;
+    }
+    if (0 == rank) {
+        all = malloc(sizeof(double) * BIBW_NUM_PHASES * numprocs);
+        OMB_CHECK_NULL_AND_EXIT(all, "Unable to allocate memory");
+    }
+    MPI_CHECK(MPI_Gather(mine, BIBW_NUM_PHASES, MPI_DOUBLE, all,
+                         BIBW_NUM_PHASES, MPI_DOUBLE, 0, comm));
+    if (0 != rank) {
+        return;
+    }
+
+    for (r = 0; r < numprocs; r++) {
+        fprintf(stdout, "# Phases (us/window) rank %d:", r);
+        total = 0.0;
+        for (ph = 0; ph < BIBW_NUM_PHASES; ph++) {
+            fprintf(stdout, " %s %.*f", phase_names[ph], FLOAT_PRECISION,
+                    all[r * BIBW_NUM_PHASES + ph]);
+            total += all[r * BIBW_NUM_PHASES + ph];
+            snprintf(name, sizeof(name), "mpi_benchmark.phase.%s",
+                     phase_names[ph]);
+            snprintf(tags, sizeof(tags), "size:%zu,rank:%d", size, r);
+            bibw_telemetry_emit(name, all[r * BIBW_NUM_PHASES + ph] / 1e3,
+                                "ms", tags);
+        }
+        fprintf(stdout, " total %.*f\n", FLOAT_PRECISION, total);
+    }
+    fflush(stdout);
+    free(all);
+}
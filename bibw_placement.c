@@ -0,0 +1,405 @@
+/*
+ * Core and NUMA placement.
+ *
+ * --bind=CPU[,CPU...] pins rank r to the r-th listed CPU (the list wraps),
+ * together with every thread the process already runs, so the MPI
+ * library's progress threads move along; threads started later (the
+ * telemetry shipper) inherit it. --membind sets a strict memory policy
+ * before any buffer is touched, so first touch places the buffers on the
+ * requested node: local is the node of the rank's CPU, remote the next
+ * node after it, or an explicit node list indexed like --bind. The
+ * benchmark's own buffers follow the policy; memory the MPI library set up
+ * during MPI_Init stays where it was.
+ *
+ * Placement is read back rather than assumed: the CPU the rank runs on,
+ * the node that CPU belongs to and the node backing the first page of the
+ * send buffer (move_pages() in query mode). The node layout comes from
+ * /sys/devices/system/node; without it everything is node 0. Policies and
+ * page queries use the raw system calls, so no libnuma is needed.
+ *
+ * --mode=placement walks the placement matrix: both ranks on every pair of
+ * nodes, with local and with remote buffers, and reports each size
+ * against the first placement (both ranks on the first node, local
+ * memory).
+ */
+#define _GNU_SOURCE
+#include "bibw.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define BIBW_MAX_NODES 64
+#define PLACEMENT_LEN 160
+
+/* Kernel ABI values from <linux/mempolicy.h> */
+#define BIBW_MPOL_DEFAULT 0
+#define BIBW_MPOL_BIND 2
+
+struct topology {
+    int nnodes;                       /* 1 + highest node id present */
+    int has_cpus[BIBW_MAX_NODES];
+    cpu_set_t cpus[BIBW_MAX_NODES];
+};
+
+static struct topology topo;
+static int topo_loaded = 0;
+
+/* "0-3,8,10-11" into set */
+static void parse_cpulist(const char *list, cpu_set_t *set)
+{
+    char *end = NULL;
+    long lo = 0, hi = 0, c = 0;
+
+    CPU_ZERO(set);
+    while ('\0' != *list && '\n' != *list) {
+        lo = strtol(list, &end, 10);
+        if (end == list) {
+            return;
+        }
+        hi = lo;
+        if ('-' == *end) {
+            list = end + 1;
+            hi = strtol(list, &end, 10);
+        }
+        for (c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+            CPU_SET(c, set);
+        }
+        list = ',' == *end ? end + 1 : end;
+    }
+}
+
+static void load_topology(void)
+{
+    char path[64], line[4096];
+    FILE *f = NULL;
+    int n = 0;
+
+    if (topo_loaded) {
+        return;
+    }
+    topo_loaded = 1;
+    memset(&topo, 0, sizeof(topo));
+    for (n = 0; n < BIBW_MAX_NODES; n++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                 n);
+        f = fopen(path, "r");
+        if (NULL == f) {
+            continue;
+        }
+        if (NULL != fgets(line, sizeof(line), f)) {
+            parse_cpulist(line, &topo.cpus[n]);
+            topo.has_cpus[n] = CPU_COUNT(&topo.cpus[n]) > 0;
+        }
+        fclose(f);
+        topo.nnodes = n + 1;
+    }
+    if (0 == topo.nnodes) {
+        topo.nnodes = 1;
+        topo.has_cpus[0] = 1;
+        sched_getaffinity(0, sizeof(cpu_set_t), &topo.cpus[0]);
+    }
+}
+
+static int node_of_cpu(int cpu)
+{
+    int n = 0;
+
+    for (n = 0; n < topo.nnodes; n++) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &topo.cpus[n])) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+/* Next node with CPUs after node, wrapping; node itself if alone */
+static int remote_node(int node)
+{
+    int i = 0, n = 0;
+
+    for (i = 1; i < topo.nnodes; i++) {
+        n = (node + i) % topo.nnodes;
+        if (topo.has_cpus[n]) {
+            return n;
+        }
+    }
+    return node;
+}
+
+/* The k-th CPU of node, wrapping; -1 if the node has none */
+static int cpu_of_node(int node, int k)
+{
+    int count = CPU_COUNT(&topo.cpus[node]), c = 0;
+
+    if (0 == count) {
+        return -1;
+    }
+    k %= count;
+    for (c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &topo.cpus[node]) && 0 == k--) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+/* Pin every thread of the process to cpu */
+static int bind_cpu(int cpu)
+{
+    cpu_set_t set;
+    struct dirent *ent = NULL;
+    DIR *dir = NULL;
+    int failed = 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    dir = opendir("/proc/self/task");
+    if (NULL == dir) {
+        return sched_setaffinity(0, sizeof(set), &set);
+    }
+    while (NULL != (ent = readdir(dir))) {
+        if ('.' != ent->d_name[0] &&
+            sched_setaffinity((pid_t)atoi(ent->d_name), sizeof(set), &set)) {
+            failed = 1;
+        }
+    }
+    closedir(dir);
+    return failed ? -1 : 0;
+}
+
+/* Strict policy for this thread's future first touches; -1 for default */
+static int bind_memory(int node)
+{
+    unsigned long mask[BIBW_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+
+    if (node < 0) {
+        return (int)syscall(SYS_set_mempolicy, BIBW_MPOL_DEFAULT, NULL, 0);
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    return (int)syscall(SYS_set_mempolicy, BIBW_MPOL_BIND, mask,
+                        sizeof(mask) * 8);
+}
+
+/* Node backing the page of buf, or -1 if unknown or not yet touched */
+static int node_of_page(const void *buf)
+{
+    void *page = (void *)((uintptr_t)buf &
+                          ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1));
+    int status = -1;
+
+    if (NULL == buf ||
+        0 != syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0)) {
+        return -1;
+    }
+    return status;
+}
+
+/* Apply cpu and memory node (-1 leaves either alone); 0 on success */
+static int place(int cpu, int node)
+{
+    if (cpu >= 0 && bind_cpu(cpu)) {
+        return -1;
+    }
+    if (node >= 0 && bind_memory(node)) {
+        return -1;
+    }
+    return 0;
+}
+
+int bibw_placement_apply(int rank)
+{
+    int cpu = -1, node = -1;
+
+    if (0 == bibw_options.num_bind_cpus &&
+        BIBW_MEMBIND_OFF == bibw_options.membind) {
+        return 0;
+    }
+    load_topology();
+    if (bibw_options.num_bind_cpus > 0) {
+        cpu = bibw_options.bind_cpus[rank % bibw_options.num_bind_cpus];
+    }
+    switch (bibw_options.membind) {
+        case BIBW_MEMBIND_LOCAL:
+            node = node_of_cpu(cpu >= 0 ? cpu : sched_getcpu());
+            break;
+        case BIBW_MEMBIND_REMOTE:
+            node = node_of_cpu(cpu >= 0 ? cpu : sched_getcpu());
+            if (remote_node(node) == node && 0 == rank) {
+                fprintf(stderr, "Warning: no remote NUMA node, buffers stay "
+                                "on node %d\n",
+                        node);
+            }
+            node = remote_node(node);
+            break;
+        case BIBW_MEMBIND_NODES:
+            node = bibw_options.mem_nodes[rank % bibw_options.num_mem_nodes];
+            break;
+    }
+    if (place(cpu, node)) {
+        fprintf(stderr, "Rank %d: unable to bind to cpu %d, memory node %d: "
+                        "%s\n",
+                rank, cpu, node, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static const char *membind_name(void)
+{
+    switch (bibw_options.membind) {
+        case BIBW_MEMBIND_LOCAL:
+            return "local";
+        case BIBW_MEMBIND_REMOTE:
+            return "remote";
+        case BIBW_MEMBIND_NODES:
+            return "node list";
+    }
+    return "default";
+}
+
+void bibw_placement_report(MPI_Comm comm, int rank, int numprocs,
+                           const void *buf)
+{
+    char line[PLACEMENT_LEN], host[MPI_MAX_PROCESSOR_NAME];
+    char *lines = NULL;
+    cpu_set_t allowed;
+    int len = 0, cpu = sched_getcpu(), page_node = -1, i = 0;
+
+    load_topology();
+    memset(host, 0, sizeof(host));
+    MPI_CHECK(MPI_Get_processor_name(host, &len));
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    page_node = node_of_page(buf);
+    len = snprintf(line, sizeof(line),
+                   "# Placement rank %d: %.40s cpu %d (node %d), %d cpus "
+                   "allowed, memory policy %s, ",
+                   rank, host, cpu, node_of_cpu(cpu), CPU_COUNT(&allowed),
+                   membind_name());
+    if (page_node >= 0) {
+        snprintf(line + len, sizeof(line) - len, "buffers on node %d",
+                 page_node);
+    } else {
+        snprintf(line + len, sizeof(line) - len, "buffers per size");
+    }
+
+    if (0 == rank) {
+        lines = malloc((size_t)numprocs * PLACEMENT_LEN);
+        OMB_CHECK_NULL_AND_EXIT(lines, "Unable to allocate memory");
+    }
+    MPI_CHECK(MPI_Gather(line, PLACEMENT_LEN, MPI_CHAR, lines, PLACEMENT_LEN,
+                         MPI_CHAR, 0, comm));
+    if (0 == rank) {
+        for (i = 0; i < numprocs; i++) {
+            fprintf(stdout, "%s\n", lines + (size_t)i * PLACEMENT_LEN);
+        }
+        fflush(stdout);
+        free(lines);
+    }
+}
+
+/*
+ * One row per (placement, size). Each placement rebinds both ranks and
+ * allocates fresh buffers under the new policy, so first touch puts them
+ * on the requested node.
+ */
+int bibw_mode_placement(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_window_t w;
+    double *baseline = NULL, t = 0.0, mb = 0.0, bw = 0.0;
+    int iterations = 0, skip = 0, n0 = 0, n1 = 0, remote = 0;
+    int my_node = 0, cpu = 0, mem = 0, failed = 0, s = 0, first = 1;
+    int nsizes = 0, page_node = -1;
+    size_t size = 0;
+
+    (void)numprocs;
+    load_topology();
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        nsizes++;
+    }
+    baseline = calloc(nsizes, sizeof(double));
+    OMB_CHECK_NULL_AND_EXIT(baseline, "Unable to allocate memory");
+
+    if (0 == rank) {
+        fprintf(stdout, "# Placement matrix: %d NUMA node%s\n", topo.nnodes,
+                1 == topo.nnodes ? " (no remote placements)" : "s");
+        fprintf(stdout, "%-10s%*s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "Rank 0 cpu/mem", FIELD_WIDTH, "Rank 1 cpu/mem", FIELD_WIDTH,
+                "Memory", FIELD_WIDTH, "Bandwidth (MB/s)", FIELD_WIDTH,
+                "vs first (%)");
+        fflush(stdout);
+    }
+
+    for (n0 = 0; n0 < topo.nnodes; n0++) {
+        for (n1 = 0; n1 < topo.nnodes; n1++) {
+            for (remote = 0; remote < 2; remote++) {
+                if (!topo.has_cpus[n0] || !topo.has_cpus[n1] ||
+                    (remote && remote_node(n0) == n0)) {
+                    continue;
+                }
+                my_node = 0 == rank ? n0 : n1;
+                /* Distinct cores when both ranks share a node */
+                cpu = cpu_of_node(my_node, rank);
+                mem = remote ? remote_node(my_node) : my_node;
+                failed = place(cpu, mem) ? 1 : 0;
+                MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT,
+                                        MPI_MAX, comm));
+                if (failed) {
+                    if (0 == rank) {
+                        fprintf(stdout, "# Nodes %d/%d %s: unable to bind, "
+                                        "skipped\n",
+                                n0, n1, remote ? "remote" : "local");
+                    }
+                    continue;
+                }
+                if (bibw_window_init(&w, comm, rank, 1 - rank,
+                                     options.window_size)) {
+                    OMB_ERROR_EXIT("Unable to allocate window");
+                }
+                iterations = options.iterations;
+                skip = options.skip;
+                for (size = options.min_message_size, s = 0;
+                     size <= options.max_message_size; size *= 2, s++) {
+                    if (bibw_window_set_size(&w, size)) {
+                        OMB_ERROR_EXIT("Unable to allocate window");
+                    }
+                    if (size > LARGE_MESSAGE_SIZE) {
+                        iterations = options.iterations_large;
+                        skip = options.skip_large;
+                    }
+                    t = bibw_window_run(&w, iterations, skip);
+                    page_node = node_of_page(w.s_buf[0]);
+                    MPI_CHECK(MPI_Bcast(&page_node, 1, MPI_INT, 1, comm));
+                    if (0 == rank) {
+                        mb = size / 1e6 * iterations * w.window_size * 2;
+                        bw = mb / t;
+                        if (first) {
+                            baseline[s] = bw;
+                        }
+                        fprintf(stdout, "%-*zu%*d/%-*d%*d/%-*d%*s%*.*f%*.*f\n",
+                                10, size, FIELD_WIDTH - 4, cpu, 3,
+                                node_of_page(w.s_buf[0]), FIELD_WIDTH - 4,
+                                cpu_of_node(n1, 1), 3, page_node, FIELD_WIDTH,
+                                remote ? "remote" : "local", FIELD_WIDTH,
+                                FLOAT_PRECISION, bw, FIELD_WIDTH,
+                                FLOAT_PRECISION, bw / baseline[s] * 100.0);
+                        fflush(stdout);
+                    }
+                }
+                bibw_window_free(&w);
+                first = 0;
+            }
+        }
+    }
+
+    free(baseline);
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * --mode=shm
+ *
+ * How much of the memory bandwidth between two co-located ranks the MPI
+ * transport delivers. MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) tells
+ * whether both ranks share a node; containers on one host that still talk
+ * over btl_tcp look the same to MPI as two machines, but not to this
+ * test. If they do share a node, every size is measured twice over the
+ * same send buffers:
+ *
+ *   MPI          the stock isend window exchange
+ *   shared copy  each rank copies its window straight into the peer's
+ *                MPI_Win_allocate_shared segment (one copy, nothing staged)
+ *                and bumps a counter in the peer's segment; the window is
+ *                complete when the peer's counter has arrived in its own
+ *
+ * Copies of --shm-nt bytes and more use non-temporal stores (SSE2), which
+ * keep large messages from evicting the receiver's cache and avoid reading
+ * the destination lines first. The shared copy is the ceiling a transport
+ * could reach; the last column is the share of it MPI gets.
+ */
+#include "bibw.h"
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SHM_LINE 64                   /* counter line ahead of the slots */
+#define SHM_SPINS 1024                /* polls between sched_yield() */
+
+struct shm_state {
+    MPI_Comm node;
+    MPI_Win win;
+    char *mine;                       /* own segment, the peer writes here */
+    char *theirs;                     /* the peer's segment */
+    size_t slot;
+    uint64_t seq;                     /* windows exchanged so far */
+};
+
+static void copy(void *dst, const void *src, size_t n, int nt)
+{
+#if defined(__SSE2__)
+    __m128i *d = dst;
+    const __m128i *s = src;
+    size_t i = 0;
+
+    if (nt && 0 == ((uintptr_t)dst & 15)) {
+        for (i = 0; i < n / 16; i++) {
+            _mm_stream_si128(d + i, _mm_loadu_si128(s + i));
+        }
+        memcpy((char *)dst + i * 16, (const char *)src + i * 16, n % 16);
+        return;
+    }
+#else
+    (void)nt;
+#endif
+    memcpy(dst, src, n);
+}
+
+static void shm_exchange(struct shm_state *sh, struct bibw_window_t *w,
+                         int nt)
+{
+    uint64_t *flag = (uint64_t *)sh->mine;
+    unsigned spins = 0;
+    int j = 0;
+
+    for (j = 0; j < w->window_size; j++) {
+        copy(sh->theirs + SHM_LINE + sh->slot * (w->nbufs > 1 ? j : 0),
+             w->s_buf[w->nbufs > 1 ? j : 0], w->size, nt);
+    }
+#if defined(__SSE2__)
+    if (nt) {
+        _mm_sfence();
+    }
+#endif
+    sh->seq++;
+    __atomic_store_n((uint64_t *)sh->theirs, sh->seq, __ATOMIC_RELEASE);
+    /* Yield now and then: containers often oversubscribe their cores */
+    while (__atomic_load_n(flag, __ATOMIC_ACQUIRE) < sh->seq) {
+        if (0 == ++spins % SHM_SPINS) {
+            sched_yield();
+        }
+    }
+}
+
+/* Returns 0 when the ranks share a node and the segments are mapped */
+static int shm_init(struct shm_state *sh, MPI_Comm comm, int rank,
+                    size_t max_size, int nbufs)
+{
+    MPI_Info info = MPI_INFO_NULL;
+    MPI_Aint bytes = 0;
+    int node_size = 0, node_rank = 0, disp_unit = 0;
+
+    memset(sh, 0, sizeof(*sh));
+    MPI_CHECK(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank,
+                                  MPI_INFO_NULL, &sh->node));
+    MPI_CHECK(MPI_Comm_size(sh->node, &node_size));
+    if (2 != node_size) {
+        MPI_CHECK(MPI_Comm_free(&sh->node));
+        return -1;
+    }
+    MPI_CHECK(MPI_Comm_rank(sh->node, &node_rank));
+
+    sh->slot = (max_size + SHM_LINE - 1) / SHM_LINE * SHM_LINE;
+    /* Each segment on its owner's NUMA node rather than one block */
+    MPI_CHECK(MPI_Info_create(&info));
+    MPI_CHECK(MPI_Info_set(info, "alloc_shared_noncontig", "true"));
+    MPI_CHECK(MPI_Win_allocate_shared(
+        (MPI_Aint)(SHM_LINE + sh->slot * nbufs), 1, info, sh->node,
+        &sh->mine, &sh->win));
+    MPI_CHECK(MPI_Info_free(&info));
+    MPI_CHECK(MPI_Win_shared_query(sh->win, 1 - node_rank, &bytes, &disp_unit,
+                                   &sh->theirs));
+    MPI_CHECK(MPI_Win_lock_all(MPI_MODE_NOCHECK, sh->win));
+    memset(sh->mine, 0, SHM_LINE + sh->slot * nbufs);
+    MPI_CHECK(MPI_Win_sync(sh->win));
+    MPI_CHECK(MPI_Barrier(sh->node));
+
+    return 0;
+}
+
+static void shm_free(struct shm_state *sh)
+{
+    MPI_CHECK(MPI_Win_unlock_all(sh->win));
+    MPI_CHECK(MPI_Win_free(&sh->win));
+    MPI_CHECK(MPI_Comm_free(&sh->node));
+}
+
+int bibw_mode_shm(MPI_Comm comm, int rank, int numprocs)
+{
+    struct bibw_window_t w;
+    struct shm_state sh;
+    struct bibw_result_t result = {0, "MPI_CHAR", NULL, 0, 0, 0.0, NULL};
+    char host[MPI_MAX_PROCESSOR_NAME], peer_host[MPI_MAX_PROCESSOR_NAME];
+    double t_mpi = 0.0, t_shm = 0.0, t_start = 0.0, mb = 0.0;
+    int iterations = options.iterations, skip = options.skip;
+    int len = 0, i = 0, nt = 0;
+    size_t size = 0;
+
+    (void)numprocs;
+    memset(host, 0, sizeof(host));
+    MPI_CHECK(MPI_Get_processor_name(host, &len));
+    MPI_CHECK(MPI_Sendrecv(host, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 1 - rank,
+                           0, peer_host, MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+                           1 - rank, 0, comm, MPI_STATUS_IGNORE));
+    if (bibw_window_init(&w, comm, rank, 1 - rank, options.window_size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    if (shm_init(&sh, comm, rank, options.max_message_size, w.nbufs)) {
+        if (0 == rank) {
+            fprintf(stdout, "# Shared memory: ranks 0 (%s) and 1 (%s) are on "
+                            "different nodes, no shared-memory path\n",
+                    host, peer_host);
+        }
+        bibw_window_free(&w);
+        return 0;
+    }
+
+    if (0 == rank) {
+        fprintf(stdout, "# Shared memory: ranks 0 and 1 share node %s, ",
+                host);
+#if defined(__SSE2__)
+        fprintf(stdout, "non-temporal stores from %d bytes\n",
+                bibw_options.shm_nt);
+#else
+        fprintf(stdout, "memcpy only (no SSE2 in this build)\n");
+#endif
+        fprintf(stdout, "%-10s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "MPI (MB/s)", FIELD_WIDTH, "Shared copy (MB/s)", FIELD_WIDTH,
+                "MPI / copy (%)");
+        fflush(stdout);
+    }
+    result.window = w.window_size;
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (bibw_window_set_size(&w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            iterations = options.iterations_large;
+            skip = options.skip_large;
+        }
+        nt = size >= (size_t)bibw_options.shm_nt;
+
+        t_mpi = bibw_window_run(&w, iterations, skip);
+
+        MPI_CHECK(MPI_Barrier(comm));
+        for (i = 0; i < iterations + skip; i++) {
+            if (i == skip) {
+                t_start = MPI_Wtime();
+            }
+            shm_exchange(&sh, &w, nt);
+        }
+        t_shm = MPI_Wtime() - t_start;
+
+        if (0 == rank) {
+            mb = size / 1e6 * iterations * w.window_size * 2;
+            fprintf(stdout, "%-*zu%*.*f%*.*f%*.*f\n", 10, size, FIELD_WIDTH,
+                    FLOAT_PRECISION, mb / t_mpi, FIELD_WIDTH, FLOAT_PRECISION,
+                    mb / t_shm, FIELD_WIDTH, FLOAT_PRECISION,
+                    t_shm / t_mpi * 100.0);
+            fflush(stdout);
+            result.size = size;
+            result.iterations = iterations;
+            result.engine = w.engine->name;
+            result.bandwidth = mb / t_mpi;
+            bibw_output_result(&result);
+            result.engine = "shm-copy";
+            result.bandwidth = mb / t_shm;
+            bibw_output_result(&result);
+        }
+    }
+
+    shm_free(&sh);
+    bibw_window_free(&w);
+    return 0;
+}
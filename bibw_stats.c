@@ -0,0 +1,82 @@
+/*
+ * Summary statistics over per-window samples.
+ */
+#include "bibw.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Two-sided 95% Student t quantiles for 1..30 degrees of freedom */
+static const double t975[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+void bibw_stats_reset(struct bibw_stats_t *st)
+{
+    st->n = 0;
+    st->mean = 0.0;
+    st->m2 = 0.0;
+}
+
+void bibw_stats_add(struct bibw_stats_t *st, double x)
+{
+    double delta = 0.0;
+
+    if (st->n == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 1024;
+        st->samples = realloc(st->samples, sizeof(double) * st->cap);
+        OMB_CHECK_NULL_AND_EXIT(st->samples, "Unable to allocate memory");
+    }
+    st->samples[st->n++] = x;
+    delta = x - st->mean;
+    st->mean += delta / st->n;
+    st->m2 += delta * (x - st->mean);
+}
+
+double bibw_stats_stddev(const struct bibw_stats_t *st)
+{
+    return st->n > 1 ? sqrt(st->m2 / (st->n - 1)) : 0.0;
+}
+
+/* Half-width of the 95% confidence interval of the mean */
+double bibw_stats_ci95(const struct bibw_stats_t *st)
+{
+    size_t df = st->n - 1;
+    double t = 1.960;
+
+    if (st->n < 2) {
+        return INFINITY;
+    }
+    if (df <= sizeof(t975) / sizeof(t975[0])) {
+        t = t975[df - 1];
+    }
+    return t * bibw_stats_stddev(st) / sqrt((double)st->n);
+}
+
+static int compare_double(const void *x, const void *y)
+{
+    double a = *(const double *)x, b = *(const double *)y;
+
+    return a < b ? -1 : a > b;
+}
+
+/* Sorts the stored samples in place */
+double bibw_stats_median(struct bibw_stats_t *st)
+{
+    if (0 == st->n) {
+        return 0.0;
+    }
+    qsort(st->samples, st->n, sizeof(double), compare_double);
+    if (st->n % 2) {
+        return st->samples[st->n / 2];
+    }
+    return (st->samples[st->n / 2 - 1] + st->samples[st->n / 2]) / 2.0;
+}
+
+void bibw_stats_free(struct bibw_stats_t *st)
+{
+    free(st->samples);
+    memset(st, 0, sizeof(*st));
+}
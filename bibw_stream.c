@@ -0,0 +1,193 @@
+/*
+ * --mode=stream
+ *
+ * Streaming instead of lock-step windows. Each rank keeps --stream-depth
+ * receives and as many sends to the peer in flight (default: -W), and
+ * whenever MPI_Waitsome (or a polling MPI_Testsome loop with
+ * --stream-completion=testsome) reports finished slots, they are reposted
+ * straight away, so the pipe never drains until the last message. Per
+ * size each direction carries --stream-bytes bytes, capped at
+ * iterations x depth messages so small sizes stay short, and at least two
+ * full depths.
+ *
+ * Reported per size:
+ *
+ *   Bandwidth   both directions, from the first post to the last completion
+ *   Steady      the same after the first depth receives completed, which
+ *               leaves out the ramp-up
+ *   p50/p99/max time from posting a receive to seeing it complete, from
+ *               the log-linear histogram (also emitted as
+ *               mpi_benchmark.stream.latency timers)
+ *
+ * The latency includes the time a completed slot waits for the next
+ * Waitsome/Testsome to notice it, which is what a streaming application
+ * sees as well.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Slot s of the window's buffers, as in -b single / multiple */
+#define SLOT(b, w, s) ((b)[(w)->nbufs > 1 ? (s) : 0])
+
+struct stream_state {
+    struct bibw_window_t w;
+    int depth;
+    MPI_Request *req;                 /* depth receives, then depth sends */
+    int *index;
+    double *t_post;
+    struct bibw_hist_t *latency;
+};
+
+static void post(struct stream_state *st, int slot)
+{
+    struct bibw_window_t *w = &st->w;
+
+    if (slot < st->depth) {
+        MPI_CHECK(MPI_Irecv(SLOT(w->r_buf, w, slot), w->count, w->dtype,
+                            w->peer, w->recv_tag, w->comm, st->req + slot));
+    } else {
+        MPI_CHECK(MPI_Isend(SLOT(w->s_buf, w, slot - st->depth), w->count,
+                            w->dtype, w->peer, w->send_tag, w->comm,
+                            st->req + slot));
+    }
+    st->t_post[slot] = MPI_Wtime();
+}
+
+/* Stream n messages each way; returns the time, t_steady from depth on */
+static double stream(struct stream_state *st, long n, double *t_steady)
+{
+    long posted[2] = {0, 0}, done[2] = {0, 0};
+    double t_start = MPI_Wtime(), t_ramp = t_start, now = 0.0;
+    int outcount = 0, slot = 0, dir = 0, i = 0, s = 0;
+
+    for (s = 0; s < st->depth && s < n; s++) {
+        post(st, s);
+        posted[0]++;
+    }
+    for (s = 0; s < st->depth && s < n; s++) {
+        post(st, st->depth + s);
+        posted[1]++;
+    }
+    while (done[0] < n || done[1] < n) {
+        if (BIBW_STREAM_TESTSOME == bibw_options.stream_completion) {
+            MPI_CHECK(MPI_Testsome(2 * st->depth, st->req, &outcount,
+                                   st->index, MPI_STATUSES_IGNORE));
+        } else {
+            MPI_CHECK(MPI_Waitsome(2 * st->depth, st->req, &outcount,
+                                   st->index, MPI_STATUSES_IGNORE));
+        }
+        if (outcount <= 0) {
+            continue;
+        }
+        now = MPI_Wtime();
+        for (i = 0; i < outcount; i++) {
+            slot = st->index[i];
+            dir = slot < st->depth ? 0 : 1;
+            done[dir]++;
+            if (0 == dir) {
+                bibw_hist_record(st->latency, now - st->t_post[slot]);
+                if (done[0] == st->depth) {
+                    t_ramp = now;
+                }
+            }
+            if (posted[dir] < n) {
+                post(st, slot);
+                posted[dir]++;
+            }
+        }
+    }
+    now = MPI_Wtime();
+    *t_steady = now - t_ramp;
+
+    return now - t_start;
+}
+
+int bibw_mode_stream(MPI_Comm comm, int rank, int numprocs)
+{
+    struct stream_state st;
+    struct bibw_result_t result = {0, "MPI_CHAR", "stream", 0, 0, 0.0, NULL};
+    char tags[BIBW_METRIC_TAGS_LEN];
+    double t = 0.0, t_steady = 0.0, mb = 0.0, steady = 0.0;
+    long n = 0, cap = options.iterations;
+    size_t size = 0;
+
+    (void)numprocs;
+    st.depth = bibw_options.stream_depth > 0 ? bibw_options.stream_depth
+                                             : (int)options.window_size;
+    if (bibw_window_init(&st.w, comm, rank, 1 - rank, st.depth)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    st.req = malloc(sizeof(MPI_Request) * 2 * st.depth);
+    st.index = malloc(sizeof(int) * 2 * st.depth);
+    st.t_post = malloc(sizeof(double) * 2 * st.depth);
+    st.latency = calloc(1, sizeof(struct bibw_hist_t));
+    if (NULL == st.req || NULL == st.index || NULL == st.t_post ||
+        NULL == st.latency) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+    bibw_hist_reset(st.latency);
+    result.window = st.depth;
+
+    if (0 == rank) {
+        fprintf(stdout, "# Streaming: %d messages in flight per direction, "
+                        "up to %d bytes per direction, %s\n",
+                st.depth, bibw_options.stream_bytes,
+                BIBW_STREAM_TESTSOME == bibw_options.stream_completion
+                    ? "MPI_Testsome"
+                    : "MPI_Waitsome");
+        fprintf(stdout, "%-10s%*s%*s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "Bandwidth (MB/s)", FIELD_WIDTH, "Steady (MB/s)", FIELD_WIDTH,
+                "Messages", FIELD_WIDTH, "p50 (us)", FIELD_WIDTH, "p99 (us)",
+                FIELD_WIDTH, "Max (us)");
+        fflush(stdout);
+    }
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (bibw_window_set_size(&st.w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            cap = options.iterations_large;
+        }
+        n = size > 0 ? (long)(bibw_options.stream_bytes / size) : 0;
+        n = n < cap * st.depth ? n : cap * st.depth;
+        n = n > 2L * st.depth ? n : 2L * st.depth;
+
+        /* One short stream to warm up, as skip does for windows */
+        MPI_CHECK(MPI_Barrier(comm));
+        stream(&st, st.depth, &t_steady);
+        bibw_hist_reset(st.latency);
+        MPI_CHECK(MPI_Barrier(comm));
+        t = stream(&st, n, &t_steady);
+
+        if (0 == rank) {
+            mb = size / 1e6 * n * 2;
+            steady = size / 1e6 * (n - st.depth) * 2 / t_steady;
+            fprintf(stdout, "%-*zu%*.*f%*.*f%*ld%*.*f%*.*f%*.*f\n", 10, size,
+                    FIELD_WIDTH, FLOAT_PRECISION, mb / t, FIELD_WIDTH,
+                    FLOAT_PRECISION, steady, FIELD_WIDTH, n, FIELD_WIDTH,
+                    FLOAT_PRECISION,
+                    bibw_hist_quantile(st.latency, 0.50) * 1e6, FIELD_WIDTH,
+                    FLOAT_PRECISION,
+                    bibw_hist_quantile(st.latency, 0.99) * 1e6, FIELD_WIDTH,
+                    FLOAT_PRECISION, st.latency->max_ns / 1e3);
+            fflush(stdout);
+            snprintf(tags, sizeof(tags), "size:%zu,depth:%d", size,
+                     st.depth);
+            bibw_hist_emit(st.latency, "mpi_benchmark.stream.latency", tags);
+            result.size = size;
+            result.iterations = (int)n;
+            result.bandwidth = mb / t;
+            bibw_output_result(&result);
+        }
+    }
+
+    free(st.req);
+    free(st.index);
+    free(st.t_post);
+    free(st.latency);
+    bibw_window_free(&st.w);
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * --mode=sweep
+ *
+ * Locates protocol switch points (eager -> rendezvous and similar) that the
+ * power-of-two grid steps over. Bandwidth normally grows with message size,
+ * so an interval across which it drops by more than --sweep-threshold
+ * percent contains a cliff. Each such interval is bisected, following the
+ * half that carries the larger part of the drop (and the other half too if
+ * it still exceeds the threshold), until it is no wider than
+ * --sweep-resolution bytes.
+ *
+ * Rank 0 decides every size to measure and broadcasts it; rank 1 follows
+ * until it receives size 0.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SWEEP_REPEATS 3 /* median of three damps single noisy windows */
+
+struct sweep_point {
+    size_t size;
+    double bw;
+    int refined;                      /* added by bisection */
+};
+
+struct sweep_cliff {
+    size_t from, to;
+    double before, after;
+};
+
+struct sweep_state {
+    struct bibw_window_t w;
+    struct sweep_point *points;
+    int npoints, max_points;
+    struct sweep_cliff *cliffs;
+    int ncliffs, max_cliffs;
+};
+
+static double median3(double a, double b, double c)
+{
+    if (a > b) {
+        double t = a;
+        a = b;
+        b = t;
+    }
+    return c < a ? a : (c > b ? b : c);
+}
+
+/* Both ranks: measure one size; the result is meaningful on rank 0 */
+static double measure(struct sweep_state *st, size_t size)
+{
+    int iterations = options.iterations, skip = options.skip;
+    double bw[SWEEP_REPEATS], mb = 0.0;
+    int r = 0;
+
+    if (bibw_window_set_size(&st->w, size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+    if (size > LARGE_MESSAGE_SIZE) {
+        iterations = options.iterations_large;
+        skip = options.skip_large;
+    }
+    mb = size / 1e6 * iterations * st->w.window_size * 2;
+    for (r = 0; r < SWEEP_REPEATS; r++) {
+        bw[r] = mb / bibw_window_run(&st->w, iterations, skip);
+    }
+
+    return median3(bw[0], bw[1], bw[2]);
+}
+
+/* Rank 0: tell rank 1 which size comes next, then measure it together */
+static double probe(struct sweep_state *st, size_t size, int refined)
+{
+    unsigned long long next = size;
+    double bw = 0.0;
+
+    MPI_CHECK(MPI_Bcast(&next, 1, MPI_UNSIGNED_LONG_LONG, 0, st->w.comm));
+    bw = measure(st, size);
+    if (st->npoints == st->max_points) {
+        st->max_points = st->max_points ? st->max_points * 2 : 64;
+        st->points = realloc(st->points,
+                             sizeof(struct sweep_point) * st->max_points);
+        OMB_CHECK_NULL_AND_EXIT(st->points, "Unable to allocate memory");
+    }
+    st->points[st->npoints].size = size;
+    st->points[st->npoints].bw = bw;
+    st->points[st->npoints].refined = refined;
+    st->npoints++;
+
+    return bw;
+}
+
+static int is_drop(double before, double after)
+{
+    return after < before * (1.0 - bibw_options.sweep_threshold / 100.0);
+}
+
+static void add_cliff(struct sweep_state *st, size_t a, double bw_a, size_t b,
+                      double bw_b)
+{
+    if (st->ncliffs == st->max_cliffs) {
+        st->max_cliffs = st->max_cliffs ? st->max_cliffs * 2 : 8;
+        st->cliffs = realloc(st->cliffs,
+                             sizeof(struct sweep_cliff) * st->max_cliffs);
+        OMB_CHECK_NULL_AND_EXIT(st->cliffs, "Unable to allocate memory");
+    }
+    st->cliffs[st->ncliffs].from = a;
+    st->cliffs[st->ncliffs].to = b;
+    st->cliffs[st->ncliffs].before = bw_a;
+    st->cliffs[st->ncliffs].after = bw_b;
+    st->ncliffs++;
+}
+
+/* Rank 0: narrow a dropping interval (a, b) down to the resolution */
+static void bisect(struct sweep_state *st, size_t a, double bw_a, size_t b,
+                   double bw_b)
+{
+    size_t mid = a + (b - a) / 2;
+    double bw_mid = 0.0;
+    int left = 0, right = 0;
+
+    if (b - a <= (size_t)bibw_options.sweep_resolution || mid == a) {
+        add_cliff(st, a, bw_a, b, bw_b);
+        return;
+    }
+    bw_mid = probe(st, mid, 1);
+    left = is_drop(bw_a, bw_mid);
+    right = is_drop(bw_mid, bw_b);
+    if (!left && !right) {
+        /* The drop spread out over both halves: follow the steeper one */
+        if (bw_a - bw_mid > bw_mid - bw_b) {
+            left = 1;
+        } else {
+            right = 1;
+        }
+    }
+    if (left) {
+        bisect(st, a, bw_a, mid, bw_mid);
+    }
+    if (right) {
+        bisect(st, mid, bw_mid, b, bw_b);
+    }
+}
+
+static int compare_point(const void *x, const void *y)
+{
+    const struct sweep_point *a = x, *b = y;
+
+    return a->size < b->size ? -1 : a->size > b->size;
+}
+
+static void report(struct sweep_state *st)
+{
+    int i = 0;
+
+    qsort(st->points, st->npoints, sizeof(struct sweep_point), compare_point);
+    fprintf(stdout, "%-10s%*s\n", "# Size", FIELD_WIDTH, "Bandwidth (MB/s)");
+    for (i = 0; i < st->npoints; i++) {
+        fprintf(stdout, "%-*zu%*.*f%s\n", 10, st->points[i].size, FIELD_WIDTH,
+                FLOAT_PRECISION, st->points[i].bw,
+                st->points[i].refined ? "  (refined)" : "");
+    }
+    fprintf(stdout, "# Detected cliffs: %d\n", st->ncliffs);
+    if (st->ncliffs > 0) {
+        fprintf(stdout, "%-12s%-12s%*s%*s%*s\n", "# From (B)", "To (B)",
+                FIELD_WIDTH, "Before (MB/s)", FIELD_WIDTH, "After (MB/s)",
+                FIELD_WIDTH, "Drop (%)");
+    }
+    for (i = 0; i < st->ncliffs; i++) {
+        fprintf(stdout, "%-12zu%-12zu%*.*f%*.*f%*.*f\n", st->cliffs[i].from,
+                st->cliffs[i].to, FIELD_WIDTH, FLOAT_PRECISION,
+                st->cliffs[i].before, FIELD_WIDTH, FLOAT_PRECISION,
+                st->cliffs[i].after, FIELD_WIDTH, FLOAT_PRECISION,
+                (1.0 - st->cliffs[i].after / st->cliffs[i].before) * 100.0);
+    }
+    fflush(stdout);
+}
+
+int bibw_mode_sweep(MPI_Comm comm, int rank, int numprocs)
+{
+    struct sweep_state st = {0};
+    unsigned long long next = 0;
+    size_t size = 0;
+    int grid = 0, i = 0;
+
+    (void)numprocs;
+    if (bibw_window_init(&st.w, comm, rank, 1 - rank, options.window_size)) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+
+    if (0 != rank) {
+        for (;;) {
+            MPI_CHECK(MPI_Bcast(&next, 1, MPI_UNSIGNED_LONG_LONG, 0, comm));
+            if (0 == next) {
+                break;
+            }
+            measure(&st, (size_t)next);
+        }
+        bibw_window_free(&st.w);
+        return 0;
+    }
+
+    fprintf(stdout, "# Adaptive sweep: cliff threshold %.1f%%, resolution "
+                    "%d B\n",
+            bibw_options.sweep_threshold, bibw_options.sweep_resolution);
+    fflush(stdout);
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        probe(&st, size, 0);
+    }
+    grid = st.npoints;
+    for (i = 1; i < grid; i++) {
+        if (is_drop(st.points[i - 1].bw, st.points[i].bw)) {
+            bisect(&st, st.points[i - 1].size, st.points[i - 1].bw,
+                   st.points[i].size, st.points[i].bw);
+        }
+    }
+    MPI_CHECK(MPI_Bcast(&next, 1, MPI_UNSIGNED_LONG_LONG, 0, comm));
+
+    report(&st);
+    free(st.points);
+    free(st.cliffs);
+    bibw_window_free(&st.w);
+    return 0;
+}
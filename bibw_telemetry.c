@@ -0,0 +1,316 @@
+/*
+ * Non-blocking StatsD client.
+ *
+ * The timed loop must not pay for socket(), address parsing or sendto() per
+ * sample, so emitting a metric only copies a fixed-size record into a
+ * preallocated single-producer/single-consumer ring. A sender thread drains
+ * the ring, packs as many newline-separated metrics as fit into one
+ * datagram and hands up to BIBW_TELEMETRY_BATCH datagrams to the kernel per
+ * sendmmsg() call over a socket that stays open for the whole run.
+ */
+#define _GNU_SOURCE
+#include "bibw.h"
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BIBW_TELEMETRY_RING 4096 /* records, power of two */
+#define BIBW_TELEMETRY_BATCH 16  /* datagrams per sendmmsg() */
+#define BIBW_TELEMETRY_MAX_DGRAM 9000
+#define BIBW_TELEMETRY_IDLE_NS 1000000L
+
+struct bibw_metric_t {
+    char name[BIBW_METRIC_NAME_LEN];
+    char tags[BIBW_METRIC_TAGS_LEN];
+    char type[4];
+    double value;
+};
+
+static struct {
+    int fd;
+    size_t payload;
+    pthread_t thread;
+    atomic_int running;
+    atomic_int stop;
+    atomic_size_t head; /* written by the producer */
+    atomic_size_t tail; /* written by the sender thread */
+    atomic_ulong dropped;
+    struct bibw_metric_t ring[BIBW_TELEMETRY_RING];
+    char dgram[BIBW_TELEMETRY_BATCH][BIBW_TELEMETRY_MAX_DGRAM];
+} telemetry = {.fd = -1};
+
+static void copy_field(char *dst, const char *src, size_t len)
+{
+    size_t i = 0;
+
+    if (NULL != src) {
+        for (; i < len - 1 && '\0' != src[i]; i++) {
+            dst[i] = src[i];
+        }
+    }
+    dst[i] = '\0';
+}
+
+/*
+ * Values are printed in fixed point with trailing zeros trimmed: some StatsD
+ * servers reject exponent notation, and %g would switch to it for both
+ * sub-microsecond timers and bytes/s.
+ */
+static int format_metric(char *dst, size_t len, const struct bibw_metric_t *m)
+{
+    char value[48];
+    int n = snprintf(value, sizeof(value), "%.6f", m->value);
+
+    if (n <= 0 || (size_t)n >= sizeof(value)) {
+        return -1;
+    }
+    while (n > 1 && '0' == value[n - 1]) {
+        value[--n] = '\0';
+    }
+    if ('.' == value[n - 1]) {
+        value[--n] = '\0';
+    }
+    if ('\0' != m->tags[0]) {
+        return snprintf(dst, len, "%s:%s|%s|#%s", m->name, value, m->type,
+                        m->tags);
+    }
+    return snprintf(dst, len, "%s:%s|%s", m->name, value, m->type);
+}
+
+static void send_batch(int ndgrams, const size_t *lens)
+{
+    int i = 0;
+#ifdef __linux__
+    struct mmsghdr msgs[BIBW_TELEMETRY_BATCH];
+    struct iovec iovs[BIBW_TELEMETRY_BATCH];
+    int sent = 0, ret = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < ndgrams; i++) {
+        iovs[i].iov_base = telemetry.dgram[i];
+        iovs[i].iov_len = lens[i];
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < ndgrams) {
+        ret = sendmmsg(telemetry.fd, msgs + sent, ndgrams - sent, 0);
+        if (ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            /* Nobody listening is not an error worth reporting per batch */
+            break;
+        }
+        sent += ret;
+    }
+#else
+    for (i = 0; i < ndgrams; i++) {
+        send(telemetry.fd, telemetry.dgram[i], lens[i], 0);
+    }
+#endif
+}
+
+/*
+ * Pack everything currently queued into datagrams and send it. Returns the
+ * number of records consumed.
+ */
+static size_t drain(void)
+{
+    size_t head = atomic_load_explicit(&telemetry.head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&telemetry.tail, memory_order_relaxed);
+    size_t lens[BIBW_TELEMETRY_BATCH];
+    size_t consumed = 0;
+    char line[BIBW_METRIC_NAME_LEN + BIBW_METRIC_TAGS_LEN + 48];
+    int ndgrams = 0, len = 0;
+
+    lens[0] = 0;
+    while (tail != head) {
+        len = format_metric(line, sizeof(line),
+                            &telemetry.ring[tail & (BIBW_TELEMETRY_RING - 1)]);
+        if (len < 0 || (size_t)len >= sizeof(line)) {
+            /* Unformattable record: skip it rather than send garbage */
+            tail++;
+            consumed++;
+            atomic_store_explicit(&telemetry.tail, tail, memory_order_release);
+            continue;
+        }
+        if (0 != lens[ndgrams] &&
+            lens[ndgrams] + 1 + (size_t)len > telemetry.payload) {
+            if (++ndgrams == BIBW_TELEMETRY_BATCH) {
+                send_batch(ndgrams, lens);
+                ndgrams = 0;
+            }
+            lens[ndgrams] = 0;
+        }
+        if (0 != lens[ndgrams]) {
+            telemetry.dgram[ndgrams][lens[ndgrams]++] = '\n';
+        }
+        memcpy(telemetry.dgram[ndgrams] + lens[ndgrams], line, (size_t)len);
+        lens[ndgrams] += (size_t)len;
+        tail++;
+        consumed++;
+        atomic_store_explicit(&telemetry.tail, tail, memory_order_release);
+    }
+    if (0 != lens[ndgrams]) {
+        ndgrams++;
+    }
+    if (ndgrams > 0) {
+        send_batch(ndgrams, lens);
+    }
+
+    return consumed;
+}
+
+static void *sender_main(void *arg)
+{
+    struct timespec idle = {0, BIBW_TELEMETRY_IDLE_NS};
+
+    (void)arg;
+    while (!atomic_load_explicit(&telemetry.stop, memory_order_acquire)) {
+        if (0 == drain()) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    drain();
+
+    return NULL;
+}
+
+int bibw_telemetry_init(const char *host, int port, int mtu)
+{
+    struct addrinfo hints, *res = NULL, *ai = NULL;
+    char service[16];
+    int ret = 0;
+
+    if (atomic_load(&telemetry.running)) {
+        return 0;
+    }
+
+    /* IPv4 + UDP headers come out of the MTU */
+    telemetry.payload = mtu > 28 ? (size_t)(mtu - 28) : 512;
+    if (telemetry.payload > BIBW_TELEMETRY_MAX_DGRAM) {
+        telemetry.payload = BIBW_TELEMETRY_MAX_DGRAM;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(service, sizeof(service), "%d", port);
+    ret = getaddrinfo(host, service, &hints, &res);
+    if (0 != ret) {
+        fprintf(stderr, "Telemetry disabled: cannot resolve %s: %s\n", host,
+                gai_strerror(ret));
+        return -1;
+    }
+    for (ai = res; NULL != ai; ai = ai->ai_next) {
+        telemetry.fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (telemetry.fd < 0) {
+            continue;
+        }
+        /* A connected UDP socket lets the sender skip the address per packet */
+        if (0 == connect(telemetry.fd, ai->ai_addr, ai->ai_addrlen)) {
+            break;
+        }
+        close(telemetry.fd);
+        telemetry.fd = -1;
+    }
+    freeaddrinfo(res);
+    if (telemetry.fd < 0) {
+        perror("Telemetry disabled: cannot open StatsD socket");
+        return -1;
+    }
+
+    atomic_store(&telemetry.head, 0);
+    atomic_store(&telemetry.tail, 0);
+    atomic_store(&telemetry.dropped, 0);
+    atomic_store(&telemetry.stop, 0);
+    if (0 != pthread_create(&telemetry.thread, NULL, sender_main, NULL)) {
+        fprintf(stderr, "Telemetry disabled: cannot start sender thread\n");
+        close(telemetry.fd);
+        telemetry.fd = -1;
+        return -1;
+    }
+    atomic_store_explicit(&telemetry.running, 1, memory_order_release);
+
+    return 0;
+}
+
+int bibw_telemetry_enabled(void)
+{
+    return atomic_load_explicit(&telemetry.running, memory_order_relaxed);
+}
+
+/*
+ * Hot path: one bounded copy into the ring, no system calls. When the
+ * sender falls behind the record is dropped and counted rather than
+ * stalling the benchmark.
+ */
+void bibw_telemetry_emit(const char *name, double value, const char *type,
+                         const char *tags)
+{
+    struct bibw_metric_t *m = NULL;
+    size_t head = 0, tail = 0;
+
+    if (!atomic_load_explicit(&telemetry.running, memory_order_relaxed)) {
+        return;
+    }
+    head = atomic_load_explicit(&telemetry.head, memory_order_relaxed);
+    tail = atomic_load_explicit(&telemetry.tail, memory_order_acquire);
+    if (head - tail >= BIBW_TELEMETRY_RING) {
+        atomic_fetch_add_explicit(&telemetry.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    m = &telemetry.ring[head & (BIBW_TELEMETRY_RING - 1)];
+    copy_field(m->name, name, sizeof(m->name));
+    copy_field(m->tags, tags, sizeof(m->tags));
+    copy_field(m->type, type, sizeof(m->type));
+    m->value = value;
+    atomic_store_explicit(&telemetry.head, head + 1, memory_order_release);
+}
+
+/*
+ * Wait until the sender thread has consumed everything queued so far. Only
+ * called outside timed regions.
+ */
+void bibw_telemetry_flush(void)
+{
+    struct timespec idle = {0, BIBW_TELEMETRY_IDLE_NS};
+    size_t head = 0;
+
+    if (!bibw_telemetry_enabled()) {
+        return;
+    }
+    head = atomic_load_explicit(&telemetry.head, memory_order_relaxed);
+    while (atomic_load_explicit(&telemetry.tail, memory_order_acquire) !=
+           head) {
+        nanosleep(&idle, NULL);
+    }
+}
+
+unsigned long bibw_telemetry_dropped(void)
+{
+    return atomic_load_explicit(&telemetry.dropped, memory_order_relaxed);
+}
+
+void bibw_telemetry_finalize(void)
+{
+    if (!bibw_telemetry_enabled()) {
+        return;
+    }
+    atomic_store_explicit(&telemetry.stop, 1, memory_order_release);
+    pthread_join(telemetry.thread, NULL);
+    atomic_store_explicit(&telemetry.running, 0, memory_order_release);
+    close(telemetry.fd);
+    telemetry.fd = -1;
+    if (bibw_telemetry_dropped() > 0) {
+        fprintf(stderr, "Telemetry: %lu metrics dropped (ring full)\n",
+                bibw_telemetry_dropped());
+    }
+}
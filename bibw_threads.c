@@ -0,0 +1,233 @@
+/*
+ * --mode=threads
+ *
+ * Each rank runs T threads that drive the bi-directional exchange
+ * concurrently under MPI_THREAD_MULTIPLE, for T = 1, 2, 4, ... up to
+ * --threads. Thread t talks to the same thread of the peer over its own
+ * duplicate of the communicator, so matching never crosses threads and
+ * any slowdown comes from the library's internal locking and progress
+ * rather than from tag contention. With --thread-window=slice (default)
+ * the threads split one window_size window between them, so the number of
+ * messages in flight matches the single-threaded run; with full each
+ * thread posts a whole window.
+ *
+ * All threads of a rank start timing together after a spin barrier that
+ * follows an MPI_Barrier between the ranks, and rank 0 reports the
+ * aggregate and the per-thread spread. Compare with --mode=pairs at the
+ * same parallelism to see what process-level parallelism would give.
+ */
+#define _GNU_SOURCE
+#include "bibw.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SPIN_YIELD_MASK 1023
+
+struct spin_barrier {
+    atomic_int arrived;
+    atomic_int sense;
+    int nthreads;
+};
+
+struct thread_ctx {
+    int tid;
+    int nthreads;
+    int rank;
+    MPI_Comm comm;                    /* per-thread duplicate */
+    MPI_Comm world;                   /* for the cross-rank barrier */
+    struct spin_barrier *barrier;
+    double *times;                    /* one slot per thread */
+    int *windows;                     /* messages per window, per thread */
+};
+
+/*
+ * Sense-reversing barrier. Threads spin on the shared sense flag; the
+ * occasional yield keeps oversubscribed containers from livelocking.
+ */
+static void spin_wait(struct spin_barrier *b, int *local_sense)
+{
+    unsigned int spins = 0;
+
+    *local_sense = !*local_sense;
+    if (atomic_fetch_add_explicit(&b->arrived, 1, memory_order_acq_rel) ==
+        b->nthreads - 1) {
+        atomic_store_explicit(&b->arrived, 0, memory_order_relaxed);
+        atomic_store_explicit(&b->sense, *local_sense, memory_order_release);
+        return;
+    }
+    while (atomic_load_explicit(&b->sense, memory_order_acquire) !=
+           *local_sense) {
+        if (0 == (++spins & SPIN_YIELD_MASK)) {
+            sched_yield();
+        }
+    }
+}
+
+static int thread_window_size(int tid, int nthreads)
+{
+    int slice = options.window_size / nthreads;
+
+    if (bibw_options.thread_full_window) {
+        return options.window_size;
+    }
+    /* Spread the remainder so the slices add up to window_size */
+    slice += tid < options.window_size % nthreads;
+    return slice > 0 ? slice : 1;
+}
+
+static void *thread_main(void *arg)
+{
+    struct thread_ctx *ctx = arg;
+    struct bibw_window_t w;
+    int iterations = options.iterations, skip = options.skip;
+    int sense = 0;
+    size_t size = 0;
+
+    ctx->windows[ctx->tid] = thread_window_size(ctx->tid, ctx->nthreads);
+    if (bibw_window_init(&w, ctx->comm, ctx->rank, 1 - ctx->rank,
+                         ctx->windows[ctx->tid])) {
+        OMB_ERROR_EXIT("Unable to allocate window");
+    }
+
+    for (size = options.min_message_size; size <= options.max_message_size;
+         size *= 2) {
+        if (bibw_window_set_size(&w, size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (size > LARGE_MESSAGE_SIZE) {
+            iterations = options.iterations_large;
+            skip = options.skip_large;
+        }
+        spin_wait(ctx->barrier, &sense);
+        if (0 == ctx->tid) {
+            MPI_CHECK(MPI_Barrier(ctx->world));
+        }
+        spin_wait(ctx->barrier, &sense);
+        ctx->times[ctx->tid] = bibw_window_time(&w, iterations, skip);
+        spin_wait(ctx->barrier, &sense);
+        /* Thread 0 of rank 0 reports while the others wait for the next size */
+        if (0 == ctx->tid && 0 == ctx->rank) {
+            double mb = 0.0, bw = 0.0, sum = 0.0, t_max = 0.0;
+            double bw_min = -1.0, bw_max = 0.0;
+            int total_window = 0, t = 0;
+
+            for (t = 0; t < ctx->nthreads; t++) {
+                mb = size / 1e6 * iterations * ctx->windows[t] * 2;
+                bw = mb / ctx->times[t];
+                sum += bw;
+                bw_min = bw_min < 0.0 || bw < bw_min ? bw : bw_min;
+                bw_max = bw > bw_max ? bw : bw_max;
+                t_max = ctx->times[t] > t_max ? ctx->times[t] : t_max;
+                total_window += ctx->windows[t];
+            }
+            mb = size / 1e6 * iterations * total_window * 2;
+            fprintf(stdout, "%-10d%-10zu%*.*f%*.*f%*.*f%*.*f\n",
+                    ctx->nthreads, size, FIELD_WIDTH, FLOAT_PRECISION,
+                    mb / t_max, FIELD_WIDTH, FLOAT_PRECISION,
+                    sum / ctx->nthreads, FIELD_WIDTH, FLOAT_PRECISION, bw_min,
+                    FIELD_WIDTH, FLOAT_PRECISION, bw_max);
+            fflush(stdout);
+        }
+        spin_wait(ctx->barrier, &sense);
+    }
+
+    bibw_window_free(&w);
+    return NULL;
+}
+
+int bibw_mode_threads(MPI_Comm comm, int rank, int numprocs)
+{
+    struct spin_barrier barrier;
+    struct thread_ctx *ctx = NULL;
+    pthread_t *threads = NULL;
+    MPI_Comm *comms = NULL;
+    double *times = NULL;
+    int *windows = NULL;
+    int provided = 0, max_threads = bibw_options.threads;
+    int nthreads = 0, t = 0;
+
+    (void)numprocs;
+    MPI_CHECK(MPI_Query_thread(&provided));
+    if (provided < MPI_THREAD_MULTIPLE) {
+        if (0 == rank) {
+            fprintf(stderr, "threads mode needs MPI_THREAD_MULTIPLE, the MPI "
+                            "library provides level %d\n",
+                    provided);
+        }
+        return 1;
+    }
+    if (0 == max_threads) {
+        max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    /* Both ranks must dup the same number of communicators */
+    MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &max_threads, 1, MPI_INT, MPI_MIN,
+                            comm));
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+
+    ctx = malloc(sizeof(struct thread_ctx) * max_threads);
+    threads = malloc(sizeof(pthread_t) * max_threads);
+    comms = malloc(sizeof(MPI_Comm) * max_threads);
+    times = malloc(sizeof(double) * max_threads);
+    windows = malloc(sizeof(int) * max_threads);
+    if (NULL == ctx || NULL == threads || NULL == comms || NULL == times ||
+        NULL == windows) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+    for (t = 0; t < max_threads; t++) {
+        MPI_CHECK(MPI_Comm_dup(comm, &comms[t]));
+    }
+
+    if (0 == rank) {
+        fprintf(stdout, "# Threads per rank up to %d, %s window of %d\n",
+                max_threads,
+                bibw_options.thread_full_window ? "full" : "sliced",
+                options.window_size);
+        fprintf(stdout, "%-10s%-10s%*s%*s%*s%*s\n", "# Threads", "Size",
+                FIELD_WIDTH, "Aggregate (MB/s)", FIELD_WIDTH,
+                "Per thread (MB/s)", FIELD_WIDTH, "Min thread (MB/s)",
+                FIELD_WIDTH, "Max thread (MB/s)");
+        fflush(stdout);
+    }
+
+    for (nthreads = 1;;
+         nthreads = nthreads * 2 < max_threads ? nthreads * 2 : max_threads) {
+        atomic_init(&barrier.arrived, 0);
+        atomic_init(&barrier.sense, 0);
+        barrier.nthreads = nthreads;
+        for (t = 0; t < nthreads; t++) {
+            ctx[t].tid = t;
+            ctx[t].nthreads = nthreads;
+            ctx[t].rank = rank;
+            ctx[t].comm = comms[t];
+            ctx[t].world = comm;
+            ctx[t].barrier = &barrier;
+            ctx[t].times = times;
+            ctx[t].windows = windows;
+            if (pthread_create(&threads[t], NULL, thread_main, &ctx[t])) {
+                OMB_ERROR_EXIT("Unable to create thread");
+            }
+        }
+        for (t = 0; t < nthreads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        if (nthreads == max_threads) {
+            break;
+        }
+    }
+
+    for (t = 0; t < max_threads; t++) {
+        MPI_CHECK(MPI_Comm_free(&comms[t]));
+    }
+    free(ctx);
+    free(threads);
+    free(comms);
+    free(times);
+    free(windows);
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * --mode=tune
+ *
+ * For each message size, search the window depth (messages in flight per
+ * direction) that gives peak bi-directional bandwidth. Depths are tried
+ * exponentially (1, 2, 4, ... --tune-max-window), then the interval around
+ * the best power of two is refined by halving the step, all within
+ * --tune-budget seconds per size. Besides the peak the table reports the
+ * knee: the shallowest depth measured within --tune-flat percent of the
+ * peak, which is the depth worth pipelining to in practice.
+ *
+ * With -b multiple every message in flight has its own send and receive
+ * buffer, so the window is set up again for each size with slots of that
+ * size, and the deepest depth tried is capped so the buffers stay within
+ * --tune-memory MB per rank.
+ *
+ * Each depth keeps the number of messages per measurement close to
+ * iterations x window_size of the stock run, so shallow windows are not
+ * judged on a handful of round trips. Rank 0 owns the search and
+ * broadcasts each depth; rank 1 follows until it receives depth 0.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct tune_probe {
+    int depth;
+    double bw;
+};
+
+struct tune_state {
+    struct bibw_window_t w;
+    size_t size;
+    int max_depth;                    /* deepest window tried at size */
+    int iterations;
+    int skip;
+    struct tune_probe *probes;
+    int nprobes;
+};
+
+/* Both ranks: measure one depth at the current size */
+static double measure(struct tune_state *st, int depth)
+{
+    int iterations = st->iterations * options.window_size / depth;
+    double mb = 0.0;
+
+    if (iterations < st->iterations) {
+        iterations = st->iterations;
+    }
+    if (bibw_window_set_depth(&st->w, depth)) {
+        OMB_ERROR_EXIT("Unable to resize window");
+    }
+    mb = st->size / 1e6 * iterations * depth * 2;
+    return mb / bibw_window_run(&st->w, iterations, st->skip);
+}
+
+/* Rank 0: measure depth unless it was already tried at this size */
+static double probe(struct tune_state *st, int depth)
+{
+    int next = depth, i = 0;
+
+    for (i = 0; i < st->nprobes; i++) {
+        if (st->probes[i].depth == depth) {
+            return st->probes[i].bw;
+        }
+    }
+    MPI_CHECK(MPI_Bcast(&next, 1, MPI_INT, 0, st->w.comm));
+    st->probes[st->nprobes].depth = depth;
+    st->probes[st->nprobes].bw = measure(st, depth);
+    return st->probes[st->nprobes++].bw;
+}
+
+static int compare_probe(const void *x, const void *y)
+{
+    const struct tune_probe *a = x, *b = y;
+
+    return a->depth - b->depth;
+}
+
+/* Rank 0: run the search for st->size and print its row */
+static void search(struct tune_state *st)
+{
+    double t_end = MPI_Wtime() + bibw_options.tune_budget;
+    double best_bw = 0.0, bw = 0.0, def_bw = 0.0, flat = 0.0;
+    int best = 1, depth = 0, step = 0, knee = 0, i = 0, done = 0;
+
+    st->nprobes = 0;
+    for (depth = 1; depth <= st->max_depth; depth *= 2) {
+        bw = probe(st, depth);
+        if (bw > best_bw) {
+            best_bw = bw;
+            best = depth;
+        }
+        if (MPI_Wtime() > t_end) {
+            break;
+        }
+    }
+    /* Refine between the neighbours of the best power of two */
+    for (step = best / 2; step >= 1 && MPI_Wtime() <= t_end; step /= 2) {
+        int center = best;
+
+        for (depth = center - step; depth <= center + step; depth += 2 * step) {
+            if (depth < 1 || depth > st->max_depth) {
+                continue;
+            }
+            bw = probe(st, depth);
+            if (bw > best_bw) {
+                best_bw = bw;
+                best = depth;
+            }
+        }
+    }
+    if (options.window_size <= st->max_depth) {
+        def_bw = probe(st, options.window_size);
+    }
+    MPI_CHECK(MPI_Bcast(&done, 1, MPI_INT, 0, st->w.comm));
+
+    qsort(st->probes, st->nprobes, sizeof(struct tune_probe), compare_probe);
+    flat = best_bw * (1.0 - bibw_options.tune_flat / 100.0);
+    for (i = 0; i < st->nprobes; i++) {
+        if (st->probes[i].bw >= flat) {
+            knee = i;
+            break;
+        }
+    }
+    fprintf(stdout, "%-*zu%*d%*.*f%*d%*.*f%*.*f%*d\n", 10, st->size,
+            FIELD_WIDTH, best, FIELD_WIDTH, FLOAT_PRECISION, best_bw,
+            FIELD_WIDTH, st->probes[knee].depth, FIELD_WIDTH, FLOAT_PRECISION,
+            st->probes[knee].bw, FIELD_WIDTH, FLOAT_PRECISION, def_bw,
+            FIELD_WIDTH, st->nprobes);
+    fflush(stdout);
+}
+
+/* Deepest window at size whose -b multiple buffers fit --tune-memory */
+static int max_depth(size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t slot = size > page ? size : page;
+    size_t fit = (size_t)bibw_options.tune_memory * 1024 * 1024 / (2 * slot);
+
+    if (options.buf_num == SINGLE ||
+        fit >= (size_t)bibw_options.tune_max_window) {
+        return bibw_options.tune_max_window;
+    }
+    return fit > 1 ? (int)fit : 1;
+}
+
+int bibw_mode_tune(MPI_Comm comm, int rank, int numprocs)
+{
+    struct tune_state st;
+    int depth = 0;
+
+    (void)numprocs;
+    memset(&st, 0, sizeof(st));
+    /* Exponential phase + refinement never revisits a depth */
+    st.probes = malloc(sizeof(struct tune_probe) *
+                       (bibw_options.tune_max_window + 1));
+    OMB_CHECK_NULL_AND_EXIT(st.probes, "Unable to allocate memory");
+    st.iterations = options.iterations;
+    st.skip = options.skip;
+
+    if (0 == rank) {
+        fprintf(stdout, "# Window tuning: depths 1..%d, %.1f s per size, "
+                        "knee within %.1f%% of peak\n",
+                bibw_options.tune_max_window, bibw_options.tune_budget,
+                bibw_options.tune_flat);
+        if (options.buf_num == MULTIPLE) {
+            fprintf(stdout, "# Depths capped so -b multiple buffers stay "
+                            "within %d MB per rank (--tune-memory)\n",
+                    bibw_options.tune_memory);
+        }
+        fprintf(stdout, "%-10s%*s%*s%*s%*s%*s%*s\n", "# Size", FIELD_WIDTH,
+                "Peak window", FIELD_WIDTH, "Peak (MB/s)", FIELD_WIDTH,
+                "Knee window", FIELD_WIDTH, "Knee (MB/s)", FIELD_WIDTH,
+                "Default (MB/s)", FIELD_WIDTH, "Probes");
+        fflush(stdout);
+    }
+
+    for (st.size = options.min_message_size;
+         st.size <= options.max_message_size; st.size *= 2) {
+        st.max_depth = max_depth(st.size);
+        if (bibw_window_init_sized(&st.w, comm, rank, 1 - rank, st.max_depth,
+                                   st.size) ||
+            bibw_window_set_size(&st.w, st.size)) {
+            OMB_ERROR_EXIT("Unable to allocate window");
+        }
+        if (st.size > LARGE_MESSAGE_SIZE) {
+            st.iterations = options.iterations_large;
+            st.skip = options.skip_large;
+        }
+        if (0 == rank) {
+            search(&st);
+        } else {
+            for (;;) {
+                MPI_CHECK(MPI_Bcast(&depth, 1, MPI_INT, 0, comm));
+                if (0 == depth) {
+                    break;
+                }
+                measure(&st, depth);
+            }
+        }
+        bibw_window_free(&st.w);
+    }
+
+    free(st.probes);
+    return 0;
+}
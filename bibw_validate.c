@@ -0,0 +1,319 @@
+/*
+ * Sampled data validation for -c (--validator=compare|crc32c).
+ *
+ * The stock path rewrites every buffer of every window byte by byte,
+ * waits on a barrier and reads every received byte back, which for 4 MB x
+ * 64 buffers costs far more than the transfer. Here a buffer holds a
+ * seeded arithmetic sequence of 64-bit words, base + w * step, with base
+ * and step hashed from the buffer's seed (the stock seeds: window index,
+ * plus the buffer index with -b multiple) and the message size. Filling
+ * and checking it is a vector add and a vector xor per four words, so
+ * both run at memory bandwidth; a changed seed per window means stale or
+ * shifted data never passes.
+ *
+ *   compare   the receiver regenerates the sequence and compares
+ *   crc32c    the sender checksums what it filled (SSE4.2 crc32 where the
+ *             CPU has it, a table otherwise) and the ranks swap checksums
+ *             after the window
+ *
+ * --validate-every=N checks every Nth timed window only, and
+ * --validate-slices=K restricts fill and check to K pseudo-random 4 KiB
+ * slices per buffer, at offsets both ranks derive from the seed. Windows
+ * that are not checked are not filled either.
+ *
+ * Everything happens between windows, outside t_start/t_end. No barrier
+ * is needed after the fill: only the own send buffers change, and the
+ * peer's data cannot land in a receive buffer before the next window
+ * posts it, which is after the check. Time and bytes spent in the
+ * validator are accumulated per size and reported as its throughput.
+ */
+#include "bibw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLICE 4096
+
+typedef uint64_t v4u __attribute__((vector_size(32), aligned(8)));
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+struct pattern {
+    uint64_t base;
+    uint64_t step;
+};
+
+static struct pattern pattern_of(int seed, size_t size)
+{
+    struct pattern p;
+
+    p.base = splitmix64((uint64_t)(unsigned)seed ^ ((uint64_t)size << 32));
+    p.step = splitmix64(p.base) | 1;
+    return p;
+}
+
+/* Word w of the sequence, as it sits in memory at byte offset 8 * w */
+static uint64_t word_at(const struct pattern *p, size_t w)
+{
+    return p->base + (uint64_t)w * p->step;
+}
+
+/* Bytes [off, off + len) of the sequence into buf; off is 8-byte aligned */
+static void fill_range(char *buf, size_t off, size_t len,
+                       const struct pattern *p)
+{
+    size_t w = off / 8, n = len / 8, i = 0;
+    v4u *out = (v4u *)(buf + off);
+    v4u v = {word_at(p, w), word_at(p, w + 1), word_at(p, w + 2),
+             word_at(p, w + 3)};
+    const v4u inc = {4 * p->step, 4 * p->step, 4 * p->step, 4 * p->step};
+    uint64_t last = 0;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        out[i / 4] = v;
+        v += inc;
+    }
+    for (; i < n; i++) {
+        last = word_at(p, w + i);
+        memcpy(buf + off + 8 * i, &last, 8);
+    }
+    if (len % 8) {
+        last = word_at(p, w + n);
+        memcpy(buf + off + 8 * n, &last, len % 8);
+    }
+}
+
+/* Nonzero if bytes [off, off + len) of buf differ from the sequence */
+static uint64_t diff_range(const char *buf, size_t off, size_t len,
+                           const struct pattern *p)
+{
+    size_t w = off / 8, n = len / 8, i = 0;
+    const v4u *in = (const v4u *)(buf + off);
+    v4u v = {word_at(p, w), word_at(p, w + 1), word_at(p, w + 2),
+             word_at(p, w + 3)};
+    const v4u inc = {4 * p->step, 4 * p->step, 4 * p->step, 4 * p->step};
+    v4u acc = {0, 0, 0, 0};
+    uint64_t diff = 0, want = 0, got = 0;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        acc |= in[i / 4] ^ v;
+        v += inc;
+    }
+    diff = acc[0] | acc[1] | acc[2] | acc[3];
+    for (; i < n; i++) {
+        memcpy(&got, buf + off + 8 * i, 8);
+        diff |= got ^ word_at(p, w + i);
+    }
+    if (len % 8) {
+        want = word_at(p, w + n);
+        got = 0;
+        memcpy(&got, buf + off + 8 * n, len % 8);
+        /* Little endian: the tail holds the low bytes of the word */
+        diff |= (got ^ want) & ((1ULL << (8 * (len % 8))) - 1);
+    }
+    return diff;
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32c_soft(uint32_t crc, const char *buf, size_t len)
+{
+    size_t i = 0;
+
+    for (i = 0; i < len; i++) {
+        crc = crc_table[(crc ^ (unsigned char)buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(uint32_t crc, const char *buf, size_t len)
+{
+    uint64_t c = crc, word = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&word, buf + i, 8);
+        c = __builtin_ia32_crc32di(c, word);
+    }
+    for (; i < len; i++) {
+        c = __builtin_ia32_crc32qi((uint32_t)c, (unsigned char)buf[i]);
+    }
+    return (uint32_t)c;
+}
+#endif
+
+static uint32_t (*crc32c)(uint32_t crc, const char *buf, size_t len) =
+    crc32c_soft;
+
+static const char *crc_impl = "table";
+
+static void crc_init(void)
+{
+    uint32_t c = 0;
+    int i = 0, b = 0;
+
+    if (0 != crc_table[1]) {
+        return;
+    }
+    for (i = 0; i < 256; i++) {
+        c = (uint32_t)i;
+        for (b = 0; b < 8; b++) {
+            c = c & 1 ? (c >> 1) ^ 0x82f63b78U : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c = crc32c_hw;
+        crc_impl = "sse4.2";
+    }
+#endif
+}
+
+int bibw_validate_init(struct bibw_validator_t *v, int nbufs)
+{
+    memset(v, 0, sizeof(*v));
+    crc_init();
+    v->crc = calloc(nbufs, sizeof(uint32_t));
+    return NULL == v->crc ? -1 : 0;
+}
+
+void bibw_validate_free(struct bibw_validator_t *v)
+{
+    free(v->crc);
+    memset(v, 0, sizeof(*v));
+}
+
+int bibw_validate_fast(void)
+{
+    return BIBW_VALIDATOR_OMB != bibw_options.validator &&
+           !options.omb_enable_ddt && NONE == options.accel;
+}
+
+int bibw_validate_due(int i, int skip)
+{
+    return i >= skip && 0 == (i - skip) % bibw_options.validate_every;
+}
+
+/* Byte offset of slice k of a size-byte buffer, the same on both ranks */
+static size_t slice_offset(const struct pattern *p, int k, size_t size)
+{
+    return splitmix64(p->base + (uint64_t)k) % (size / SLICE) * SLICE;
+}
+
+static int sliced(size_t size)
+{
+    return bibw_options.validate_slices > 0 &&
+           (size_t)bibw_options.validate_slices * SLICE < size;
+}
+
+void bibw_validate_fill(struct bibw_validator_t *v, char **s_buf, int nbufs,
+                        size_t size, int seed)
+{
+    struct pattern p;
+    double t_start = MPI_Wtime();
+    uint32_t crc = 0;
+    int j = 0, k = 0;
+
+    for (j = 0; j < nbufs; j++) {
+        p = pattern_of(seed + j, size);
+        if (!sliced(size)) {
+            fill_range(s_buf[j], 0, size, &p);
+            v->fill_bytes += size;
+        } else {
+            for (k = 0; k < bibw_options.validate_slices; k++) {
+                fill_range(s_buf[j], slice_offset(&p, k, size), SLICE, &p);
+            }
+            v->fill_bytes += (size_t)bibw_options.validate_slices * SLICE;
+        }
+        if (BIBW_VALIDATOR_CRC32C == bibw_options.validator) {
+            crc = 0xffffffffU;
+            if (!sliced(size)) {
+                crc = crc32c(crc, s_buf[j], size);
+            } else {
+                for (k = 0; k < bibw_options.validate_slices; k++) {
+                    crc = crc32c(crc, s_buf[j] + slice_offset(&p, k, size),
+                                 SLICE);
+                }
+            }
+            v->crc[j] = ~crc;
+        }
+    }
+    v->fill_time += MPI_Wtime() - t_start;
+}
+
+int bibw_validate_check(struct bibw_validator_t *v, MPI_Comm comm, int peer,
+                        char **r_buf, int nbufs, size_t size, int seed)
+{
+    struct pattern p;
+    double t_start = 0.0;
+    uint32_t crc = 0;
+    int j = 0, k = 0, errors = 0;
+
+    if (BIBW_VALIDATOR_CRC32C == bibw_options.validator) {
+        MPI_CHECK(MPI_Sendrecv_replace(v->crc, nbufs, MPI_UINT32_T, peer, 0,
+                                       peer, 0, comm, MPI_STATUS_IGNORE));
+    }
+    t_start = MPI_Wtime();
+    for (j = 0; j < nbufs; j++) {
+        p = pattern_of(seed + j, size);
+        if (BIBW_VALIDATOR_CRC32C == bibw_options.validator) {
+            crc = 0xffffffffU;
+            if (!sliced(size)) {
+                crc = crc32c(crc, r_buf[j], size);
+            } else {
+                for (k = 0; k < bibw_options.validate_slices; k++) {
+                    crc = crc32c(crc, r_buf[j] + slice_offset(&p, k, size),
+                                 SLICE);
+                }
+            }
+            errors += ~crc != v->crc[j];
+        } else if (!sliced(size)) {
+            errors += 0 != diff_range(r_buf[j], 0, size, &p);
+        } else {
+            for (k = 0; k < bibw_options.validate_slices; k++) {
+                errors += 0 != diff_range(r_buf[j],
+                                          slice_offset(&p, k, size), SLICE,
+                                          &p);
+            }
+        }
+        v->check_bytes += sliced(size)
+                              ? (size_t)bibw_options.validate_slices * SLICE
+                              : size;
+    }
+    v->check_time += MPI_Wtime() - t_start;
+    v->checked++;
+
+    return errors;
+}
+
+void bibw_validate_reset(struct bibw_validator_t *v)
+{
+    v->checked = 0;
+    v->fill_bytes = 0;
+    v->check_bytes = 0;
+    v->fill_time = 0.0;
+    v->check_time = 0.0;
+}
+
+void bibw_validate_report(const struct bibw_validator_t *v, int windows)
+{
+    fprintf(stdout, "# Validation (%s%s%s): %ld of %d windows, fill %.2f GB/s, "
+                    "check %.2f GB/s, %.3f s outside the timed region\n",
+            BIBW_VALIDATOR_CRC32C == bibw_options.validator ? "crc32c/"
+                                                            : "compare",
+            BIBW_VALIDATOR_CRC32C == bibw_options.validator ? crc_impl : "",
+            bibw_options.validate_slices > 0 ? ", sliced" : "", v->checked,
+            windows, v->fill_time > 0.0 ? v->fill_bytes / v->fill_time / 1e9
+                                        : 0.0,
+            v->check_time > 0.0 ? v->check_bytes / v->check_time / 1e9 : 0.0,
+            v->fill_time + v->check_time);
+}
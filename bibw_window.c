@@ -0,0 +1,297 @@
+/*
+ * The bi-directional window exchange used by the measurement modes and by
+ * the extra engine columns of the regular sweep.
+ */
+#include "bibw.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int allocate_buffers(struct bibw_window_t *w, size_t size)
+{
+    int i = 0;
+
+    for (i = 0; i < w->nbufs; i++) {
+        if (options.buf_num == SINGLE) {
+            if (allocate_memory_pt2pt(&w->s_buf[i], &w->r_buf[i], w->rank)) {
+                return -1;
+            }
+        } else if (allocate_memory_pt2pt_size(&w->s_buf[i], &w->r_buf[i],
+                                              w->rank, size)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void free_buffers(struct bibw_window_t *w)
+{
+    int i = 0;
+
+    if (NULL != w->arena.base) {
+        bibw_arena_free(&w->arena);
+        return;
+    }
+    for (i = 0; i < w->nbufs; i++) {
+        if (NULL != w->s_buf[i]) {
+            free_memory(w->s_buf[i], w->r_buf[i], w->rank);
+            w->s_buf[i] = NULL;
+            w->r_buf[i] = NULL;
+        }
+    }
+}
+
+static void release_engine(struct bibw_window_t *w)
+{
+    if (w->prepared && NULL != w->engine->release) {
+        w->engine->release(w);
+    }
+    w->prepared = 0;
+}
+
+static int setup(struct bibw_window_t *w, MPI_Comm comm, int rank, int peer,
+                 int window_size)
+{
+    memset(w, 0, sizeof(*w));
+    w->comm = comm;
+    w->rank = rank;
+    w->peer = peer;
+    /*
+     * The lower rank of the pair takes main()'s rank 0 tags (send 100,
+     * receive 10) so the pairing matches the stock benchmark.
+     */
+    w->send_tag = rank < peer ? 100 : 10;
+    w->recv_tag = rank < peer ? 10 : 100;
+    w->window_size = window_size;
+    w->max_window = window_size;
+    w->nbufs = options.buf_num == MULTIPLE ? window_size : 1;
+    w->dtype = MPI_CHAR;
+    w->engine = &bibw_engine_isend;
+    w->send_request = malloc(sizeof(MPI_Request) * window_size);
+    w->recv_request = malloc(sizeof(MPI_Request) * window_size);
+    if (NULL == w->send_request || NULL == w->recv_request) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Set up a window towards peer that allocates its own buffers */
+int bibw_window_init(struct bibw_window_t *w, MPI_Comm comm, int rank,
+                     int peer, int window_size)
+{
+    return bibw_window_init_sized(w, comm, rank, peer, window_size,
+                                  options.max_message_size);
+}
+
+/*
+ * The same for messages of up to max_size bytes, so a -b multiple arena
+ * of window_size slots does not have to hold the largest size of the run.
+ */
+int bibw_window_init_sized(struct bibw_window_t *w, MPI_Comm comm, int rank,
+                           int peer, int window_size, size_t max_size)
+{
+    if (setup(w, comm, rank, peer, window_size)) {
+        return -1;
+    }
+    w->owns_buffers = 1;
+    w->s_buf = calloc(w->nbufs, sizeof(char *));
+    w->r_buf = calloc(w->nbufs, sizeof(char *));
+    if (NULL == w->s_buf || NULL == w->r_buf) {
+        return -1;
+    }
+    if (options.buf_num == SINGLE) {
+        return allocate_buffers(w, max_size);
+    }
+    if (bibw_arena_active()) {
+        if (bibw_arena_init(&w->arena, max_size, w->nbufs, rank)) {
+            return -1;
+        }
+        bibw_arena_carve(&w->arena, w->s_buf, w->r_buf);
+        bibw_arena_warm(&w->arena, comm, peer);
+    }
+
+    return 0;
+}
+
+/*
+ * Set up a window over buffers owned by the caller (main()'s s_buf/r_buf).
+ * The caller allocates and touches them; bibw_window_set_type() only
+ * describes what they hold.
+ */
+int bibw_window_borrow(struct bibw_window_t *w, MPI_Comm comm, int rank,
+                       int peer, int window_size, char **s_buf, char **r_buf)
+{
+    if (setup(w, comm, rank, peer, window_size)) {
+        return -1;
+    }
+    w->s_buf = s_buf;
+    w->r_buf = r_buf;
+
+    return 0;
+}
+
+void bibw_window_set_engine(struct bibw_window_t *w,
+                            const struct bibw_engine_t *engine)
+{
+    if (engine == w->engine) {
+        return;
+    }
+    release_engine(w);
+    w->engine = engine;
+    if (w->size > 0 && NULL != engine->prepare) {
+        if (engine->prepare(w)) {
+            OMB_ERROR_EXIT("Unable to prepare window engine");
+        }
+        w->prepared = 1;
+    }
+}
+
+/*
+ * Describe the messages of the next size: count elements of dtype, size
+ * bytes in total. The engine rebuilds whatever it keeps per size.
+ */
+int bibw_window_set_type(struct bibw_window_t *w, size_t size, int count,
+                         MPI_Datatype dtype)
+{
+    release_engine(w);
+    w->size = size;
+    w->count = count;
+    w->dtype = dtype;
+    if (NULL != w->engine->prepare) {
+        if (w->engine->prepare(w)) {
+            return -1;
+        }
+        w->prepared = 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Resize an owning window of MPI_CHAR messages and touch the buffers, as
+ * the size loop in main() does.
+ */
+int bibw_window_set_size(struct bibw_window_t *w, size_t size)
+{
+    int i = 0;
+
+    release_engine(w);
+    if (NULL != w->arena.base) {
+        /* Slots are already carved and faulted in */
+        return bibw_window_set_type(w, size, (int)size, MPI_CHAR);
+    }
+    if (options.buf_num == MULTIPLE) {
+        free_buffers(w);
+        if (allocate_buffers(w, size)) {
+            return -1;
+        }
+    }
+    for (i = 0; i < w->nbufs; i++) {
+        set_buffer_pt2pt(w->s_buf[i], w->rank, options.accel, 'a', size);
+        set_buffer_pt2pt(w->r_buf[i], w->rank, options.accel, 'b', size);
+    }
+
+    return bibw_window_set_type(w, size, (int)size, MPI_CHAR);
+}
+
+/*
+ * Use only the first window_size messages of the window (up to the depth
+ * it was set up with). Persistent engines rebuild their requests.
+ */
+int bibw_window_set_depth(struct bibw_window_t *w, int window_size)
+{
+    if (window_size < 1 || window_size > w->max_window) {
+        return -1;
+    }
+    if (window_size == w->window_size) {
+        return 0;
+    }
+    release_engine(w);
+    w->window_size = window_size;
+    if (w->size > 0 && NULL != w->engine->prepare) {
+        if (w->engine->prepare(w)) {
+            return -1;
+        }
+        w->prepared = 1;
+    }
+
+    return 0;
+}
+
+void bibw_window_exchange(struct bibw_window_t *w)
+{
+    w->engine->exchange(w);
+}
+
+/*
+ * The isend exchange split at the point where every message is in flight,
+ * for modes that do other work before completing it. Independent of the
+ * window's engine.
+ */
+void bibw_window_post(struct bibw_window_t *w)
+{
+    int j = 0;
+
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Irecv(w->r_buf[w->nbufs > 1 ? j : 0], w->count,
+                            w->dtype, w->peer, w->recv_tag, w->comm,
+                            w->recv_request + j));
+    }
+    for (j = 0; j < w->window_size; j++) {
+        MPI_CHECK(MPI_Isend(w->s_buf[w->nbufs > 1 ? j : 0], w->count,
+                            w->dtype, w->peer, w->send_tag, w->comm,
+                            w->send_request + j));
+    }
+}
+
+void bibw_window_wait(struct bibw_window_t *w)
+{
+    MPI_CHECK(MPI_Waitall(w->window_size, w->send_request,
+                          MPI_STATUSES_IGNORE));
+    MPI_CHECK(MPI_Waitall(w->window_size, w->recv_request,
+                          MPI_STATUSES_IGNORE));
+}
+
+/*
+ * Run skip warm-up windows, then time iterations windows. Returns the
+ * elapsed time of the timed windows on the calling rank.
+ */
+double bibw_window_time(struct bibw_window_t *w, int iterations, int skip)
+{
+    double t_start = 0.0;
+    int i = 0;
+
+    for (i = 0; i < iterations + skip; i++) {
+        if (i == skip) {
+            t_start = MPI_Wtime();
+        }
+        w->engine->exchange(w);
+    }
+
+    return MPI_Wtime() - t_start;
+}
+
+/* bibw_window_time() after a barrier over the window's communicator */
+double bibw_window_run(struct bibw_window_t *w, int iterations, int skip)
+{
+    MPI_CHECK(MPI_Barrier(w->comm));
+    return bibw_window_time(w, iterations, skip);
+}
+
+void bibw_window_free(struct bibw_window_t *w)
+{
+    if (NULL != w->engine) {
+        release_engine(w);
+    }
+    if (w->owns_buffers) {
+        if (NULL != w->s_buf) {
+            free_buffers(w);
+        }
+        free(w->s_buf);
+        free(w->r_buf);
+    }
+    free(w->send_request);
+    free(w->recv_request);
+    memset(w, 0, sizeof(*w));
+}
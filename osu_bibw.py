@@ -33,6 +33,9 @@ def osu_bw(
     if myid == 0:
         print ('# %-8s%20s' % ("Size [B]", "Bandwidth [MB/s]"))
 
+    send_request = [MPI.REQUEST_NULL] * window_size
+    recv_request = [MPI.REQUEST_NULL] * window_size
+
     message_sizes = [2**i for i in range(30)]
     for size in message_sizes:
         if size > MAX_MSG_SIZE:
@@ -41,13 +44,17 @@ def osu_bw(
             skip = skip_large
             loop = loop_large
             window_size = window_size_large
+        if len(send_request) != window_size:
+            send_request = [MPI.REQUEST_NULL] * window_size
+            recv_request = [MPI.REQUEST_NULL] * window_size
 
-        iterations = list(range(loop+skip))
-        window_sizes = list(range(window_size))
+        iterations = range(loop+skip)
+        window_sizes = range(window_size)
         s_msg = [s_buf, size, MPI.BYTE]
         r_msg = [r_buf, size, MPI.BYTE]
-        send_request = [MPI.REQUEST_NULL] * window_size
-        recv_request = [MPI.REQUEST_NULL] * window_size
+        # Touch the data every size, as osu_bibw does
+        touch(s_buf, size, 'a')
+        touch(r_buf, size, 'b')
         #
         comm.Barrier()
         if myid == 0:
@@ -67,11 +74,12 @@ def osu_bw(
                     recv_request[j] = comm.Irecv(r_msg, 0, 100)
                 for j in window_sizes:
                     send_request[j] = comm.Isend(s_msg, 0, 10)
-                MPI.Request.Waitall(send_request)
                 MPI.Request.Waitall(recv_request)
+                MPI.Request.Waitall(send_request)
         #
         if myid == 0:
-            MB = size / 1e6 * loop * window_size
+            # Both directions carry the window
+            MB = size / 1e6 * loop * window_size * 2
             s = t_end - t_start
             print ('%-10d%20.2f' % (size, MB/s))
 
@@ -89,5 +97,17 @@ def allocate(n):
             return array('B', [0]) * n
 
 
+def touch(buf, n, char):
+    from array import array
+    # mmap takes bytes, numpy a scalar, array another array
+    for value in (bytes(char, 'ascii') * n, ord(char),
+                  array('B', [ord(char)]) * n):
+        try:
+            buf[:n] = value
+            return
+        except (TypeError, ValueError):
+            pass
+
+
 if __name__ == '__main__':
     osu_bw()
@@ -0,0 +1,375 @@
+#!/usr/bin/env python3
+"""mpi4py counterpart of osu_bibw_modified for C-vs-Python comparisons.
+
+Runs the same schedule as the C benchmark: per size the buffers are
+touched again, the ranks synchronise with a barrier, skip warm-up windows
+run before iterations timed windows of window_size MPI_Irecv + MPI_Isend
+per direction (tags, posting order and MPI_Waitall order as in the C main
+loop), and the iteration, skip and window counts switch at the same
+LARGE_MESSAGE_SIZE. Bandwidth counts both directions. Buffers are numpy
+arrays (mmap when numpy is missing), handed to MPI without copies, and
+the message specifications and request lists are built once, outside the
+timed windows.
+
+--engines=persistent additionally measures each size with persistent
+requests (MPI_Send_init/MPI_Recv_init once per size, MPI_Startall per
+window), the C side's persistent engine. --mode=calls measures the
+null-call cost of MPI_Irecv, MPI_Isend and MPI_Waitall on the schedule of
+the C --mode=calls, and --output=json|csv writes the same records as the
+C --output option, so bibw_compare.py --decompose can split the gap
+between the two into per-call binding overhead and data movement.
+"""
+
+import argparse
+import math
+import mmap
+import sys
+import time
+
+from mpi4py import MPI
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+LARGE_MESSAGE_SIZE = 8192
+FIELD_WIDTH = 20
+FLOAT_PRECISION = 2
+
+T975 = [
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+]
+
+
+class Stats:
+    """Per-window samples; the same summary bibw_stats.c computes."""
+
+    def __init__(self):
+        self.samples = []
+
+    def add(self, x):
+        self.samples.append(x)
+
+    @property
+    def n(self):
+        return len(self.samples)
+
+    def mean(self):
+        return sum(self.samples) / self.n if self.samples else math.nan
+
+    def stddev(self):
+        if self.n < 2:
+            return 0.0
+        m = self.mean()
+        return math.sqrt(sum((x - m) ** 2 for x in self.samples) /
+                         (self.n - 1))
+
+    def median(self):
+        if not self.samples:
+            return math.nan
+        s = sorted(self.samples)
+        h = self.n // 2
+        return s[h] if self.n % 2 else (s[h - 1] + s[h]) / 2.0
+
+    def ci95(self):
+        if self.n < 2:
+            return math.inf
+        t = T975[self.n - 2] if self.n - 1 <= len(T975) else 1.960
+        return t * self.stddev() / math.sqrt(self.n)
+
+
+def allocate(n):
+    if numpy is not None:
+        return numpy.empty(max(n, 1), dtype='B')
+    return mmap.mmap(-1, max(n, 1))
+
+
+def touch(buf, char, n):
+    if numpy is not None:
+        buf[:n] = ord(char)
+    else:
+        buf[:n] = char.encode() * n
+
+
+class Output:
+    """Structured records in the layout bibw_output.c writes."""
+
+    COLUMNS = ("size,datatype,engine,window,iterations,bandwidth_mbs,"
+               "samples,mean_mbs,median_mbs,stddev_mbs,ci95_mbs")
+
+    def __init__(self, fmt, path, meta):
+        self.fmt = fmt
+        self.f = open(path, "w")
+        if fmt == "json":
+            import json
+            self.json = json
+            self.f.write(json.dumps(dict(type="run", **meta)) + "\n")
+        else:
+            for key, value in meta.items():
+                if isinstance(value, list):
+                    value = ",".join(value)
+                self.f.write("# %s: %s\n" % (key, value))
+            self.f.write(self.COLUMNS + "\n")
+        self.f.flush()
+
+    @staticmethod
+    def number(x):
+        return x if x is not None and math.isfinite(x) else None
+
+    def result(self, size, engine, window, iterations, bandwidth, st=None):
+        n = st.n if st is not None else 0
+        stats = ((st.mean(), st.median(), st.stddev(), st.ci95()) if n
+                 else (None,) * 4)
+        stats = [self.number(x) for x in stats]
+        if self.fmt == "json":
+            rec = dict(type="result", size=size, datatype="MPI_CHAR",
+                       engine=engine, window=window, iterations=iterations,
+                       bandwidth_mbs=self.number(bandwidth), samples=n,
+                       mean_mbs=stats[0], median_mbs=stats[1],
+                       stddev_mbs=stats[2], ci95_mbs=stats[3])
+            self.f.write(self.json.dumps(rec) + "\n")
+        else:
+            fields = [size, "MPI_CHAR", engine, window, iterations,
+                      bandwidth, n] + stats
+            self.f.write(",".join("" if x is None else
+                                  ("%.6f" % x if isinstance(x, float)
+                                   else str(x)) for x in fields) + "\n")
+        self.f.flush()
+
+    def call(self, name, st):
+        if self.fmt == "json":
+            rec = dict(type="call", call=name, samples=st.n,
+                       mean_ns=st.mean(), median_ns=st.median(),
+                       stddev_ns=st.stddev())
+            self.f.write(self.json.dumps(rec) + "\n")
+        else:
+            self.f.write("# call.%s_ns: %.6f\n" % (name, st.mean()))
+        self.f.flush()
+
+    def close(self):
+        self.f.close()
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(
+        description="mpi4py bi-directional bandwidth, matched to "
+                    "osu_bibw_modified")
+    parser.add_argument("-m", dest="sizes", default="1:4194304",
+                        help="[MIN:]MAX message size (default 1:4194304)")
+    parser.add_argument("-i", dest="iterations", type=int,
+                        help="timed windows per size (default 100, 20 "
+                             "above %d B)" % LARGE_MESSAGE_SIZE)
+    parser.add_argument("-x", dest="skip", type=int,
+                        help="warm-up windows per size (default 10, 2 above "
+                             "%d B)" % LARGE_MESSAGE_SIZE)
+    parser.add_argument("-W", dest="window", type=int, default=64,
+                        help="messages in flight per direction (default 64)")
+    parser.add_argument("--engines", default="",
+                        help="extra engines next to isend: persistent")
+    parser.add_argument("--mode", choices=("calls",),
+                        help="calls: null-call cost instead of the sweep")
+    parser.add_argument("--output", choices=("text", "json", "csv"),
+                        default="text")
+    parser.add_argument("--output-file")
+    args = parser.parse_args(argv)
+
+    lo, _, hi = args.sizes.rpartition(":")
+    args.min_size, args.max_size = int(lo or 1), int(hi)
+    args.iterations_large = args.iterations or 20
+    args.iterations = args.iterations or 100
+    args.skip_large = 2 if args.skip is None else args.skip
+    args.skip = 10 if args.skip is None else args.skip
+    args.engines = [e for e in args.engines.split(",") if e and e != "isend"]
+    for e in args.engines:
+        if e != "persistent":
+            parser.error("unknown engine %s" % e)
+    return args
+
+
+def open_output(args, comm, rank):
+    hosts = comm.gather(MPI.Get_processor_name(), root=0)
+    if args.output == "text" or rank != 0:
+        return None
+    major, minor = MPI.Get_version()
+    meta = dict(
+        benchmark="osu_bibw", implementation="python",
+        mode=args.mode or "bibw",
+        timestamp=time.strftime("%Y-%m-%dT%H:%M:%SZ", time.gmtime()),
+        mpi_library=MPI.Get_library_version().splitlines()[0].strip("\0 "),
+        mpi_version="%d.%d" % (major, minor), nprocs=comm.Get_size(),
+        hosts=hosts, window=args.window, iterations=args.iterations,
+        iterations_large=args.iterations_large, skip=args.skip,
+        skip_large=args.skip_large, min_size=args.min_size,
+        max_size=args.max_size, buffers="single", arena="off",
+        engines=["isend"] + args.engines)
+    path = args.output_file or ("osu_bibw.jsonl" if args.output == "json"
+                                else "osu_bibw.csv")
+    return Output(args.output, path, meta)
+
+
+def run_calls(args, comm, rank, out):
+    """Same schedule and timing points as bibw_calls.c."""
+    peer = 1 - rank
+    send_tag, recv_tag = (100, 10) if rank < peer else (10, 100)
+    window = args.window
+    buf = allocate(1)
+    msg = [buf, 0, MPI.CHAR]
+    send_request = [MPI.REQUEST_NULL] * window
+    recv_request = [MPI.REQUEST_NULL] * window
+    nulls = [MPI.REQUEST_NULL] * window
+    stats = dict(MPI_Irecv=Stats(), MPI_Isend=Stats(), MPI_Waitall=Stats())
+    slots = range(window)
+    wtime = MPI.Wtime
+
+    comm.Barrier()
+    for i in range(args.iterations + args.skip):
+        t0 = wtime()
+        for j in slots:
+            recv_request[j] = comm.Irecv(msg, peer, recv_tag)
+        t1 = wtime()
+        for j in slots:
+            send_request[j] = comm.Isend(msg, peer, send_tag)
+        t2 = wtime()
+        MPI.Request.Waitall(send_request)
+        MPI.Request.Waitall(recv_request)
+        t3 = wtime()
+        MPI.Request.Waitall(nulls)
+        t4 = wtime()
+        if i >= args.skip:
+            stats["MPI_Irecv"].add((t1 - t0) * 1e9 / window)
+            stats["MPI_Isend"].add((t2 - t1) * 1e9 / window)
+            stats["MPI_Waitall"].add((t4 - t3) * 1e9)
+
+    if rank == 0:
+        print("# Null-call cost: %d zero-byte messages per window and "
+              "direction, %d windows" % (window, args.iterations))
+        print("%-14s%*s%*s%*s" % ("# Call", FIELD_WIDTH, "Mean (ns)",
+                                  FIELD_WIDTH, "Median (ns)", FIELD_WIDTH,
+                                  "Stddev (ns)"))
+        for name, st in stats.items():
+            print("%-14s%*.*f%*.*f%*.*f" % (
+                name, FIELD_WIDTH, FLOAT_PRECISION, st.mean(), FIELD_WIDTH,
+                FLOAT_PRECISION, st.median(), FIELD_WIDTH, FLOAT_PRECISION,
+                st.stddev()))
+            if out is not None:
+                out.call(name, st)
+        sys.stdout.flush()
+
+
+def run_persistent(comm, peer, send_tag, recv_tag, s_msg, r_msg, window,
+                   iterations, skip):
+    """The C persistent engine through bibw_window_run()."""
+    recv_request = [comm.Recv_init(r_msg, peer, recv_tag)
+                    for _ in range(window)]
+    send_request = [comm.Send_init(s_msg, peer, send_tag)
+                    for _ in range(window)]
+    startall, waitall = MPI.Prequest.Startall, MPI.Request.Waitall
+
+    comm.Barrier()
+    for i in range(iterations + skip):
+        if i == skip:
+            t_start = MPI.Wtime()
+        startall(recv_request)
+        startall(send_request)
+        waitall(send_request)
+        waitall(recv_request)
+    elapsed = MPI.Wtime() - t_start
+
+    for req in recv_request + send_request:
+        req.Free()
+    return elapsed
+
+
+def run_sweep(args, comm, rank, out):
+    peer = 1 - rank
+    send_tag, recv_tag = (100, 10) if rank < peer else (10, 100)
+    window = args.window
+    s_buf = allocate(args.max_size)
+    r_buf = allocate(args.max_size)
+    send_request = [MPI.REQUEST_NULL] * window
+    recv_request = [MPI.REQUEST_NULL] * window
+    slots = range(window)
+    wtime, waitall = MPI.Wtime, MPI.Request.Waitall
+    iterations, skip = args.iterations, args.skip
+
+    if rank == 0:
+        print("# OSU MPI-Python Bi-Directional Bandwidth Test")
+        print("%-10s%*s" % ("# Size", FIELD_WIDTH, "Bandwidth (MB/s)"))
+        if args.engines:
+            print("# Trailing columns:" +
+                  "".join(" %s (MB/s)" % e for e in args.engines))
+        sys.stdout.flush()
+
+    size = args.min_size
+    while size <= args.max_size:
+        touch(s_buf, "a", size)
+        touch(r_buf, "b", size)
+        s_msg = [s_buf, size, MPI.CHAR]
+        r_msg = [r_buf, size, MPI.CHAR]
+        if size > LARGE_MESSAGE_SIZE:
+            iterations, skip = args.iterations_large, args.skip_large
+        mb = size / 1e6 * window * 2
+        t_total = 0.0
+        windows = Stats()
+
+        comm.Barrier()
+        for i in range(iterations + skip):
+            t_start = wtime()
+            for j in slots:
+                recv_request[j] = comm.Irecv(r_msg, peer, recv_tag)
+            for j in slots:
+                send_request[j] = comm.Isend(s_msg, peer, send_tag)
+            if rank == 0:
+                waitall(send_request)
+                waitall(recv_request)
+            else:
+                waitall(recv_request)
+                waitall(send_request)
+            t_end = wtime()
+            if i >= skip and rank == 0:
+                t_total += t_end - t_start
+                windows.add(mb / (t_end - t_start))
+
+        engine_time = [run_persistent(comm, peer, send_tag, recv_tag, s_msg,
+                                      r_msg, window, iterations, skip)
+                       for _ in args.engines]
+
+        if rank == 0:
+            total = mb * iterations
+            print("%-10d%*.*f" % (size, FIELD_WIDTH, FLOAT_PRECISION,
+                                  total / t_total) +
+                  "".join("%*.*f" % (FIELD_WIDTH, FLOAT_PRECISION, total / t)
+                          for t in engine_time))
+            sys.stdout.flush()
+            if out is not None:
+                out.result(size, "isend", window, iterations,
+                           total / t_total, windows)
+                for name, t in zip(args.engines, engine_time):
+                    out.result(size, name, window, iterations, total / t)
+        size *= 2
+
+
+def main(argv):
+    comm = MPI.COMM_WORLD
+    rank = comm.Get_rank()
+    args = parse_args(argv)
+    if comm.Get_size() != 2:
+        if rank == 0:
+            sys.stderr.write("This test requires exactly two processes\n")
+        return 1
+
+    out = open_output(args, comm, rank)
+    if args.mode == "calls":
+        run_calls(args, comm, rank, out)
+    else:
+        run_sweep(args, comm, rank, out)
+    if out is not None:
+        out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -12,45 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
-#include <sys/socket.h>  // Pour socket(), SOCK_DGRAM, etc.
-#include <netinet/in.h>  // Pour struct sockaddr_in et AF_INET
-#include <arpa/inet.h>   // Pour inet_pton()
-#include <unistd.h>      // Pour close()
-
-void chrono(const char *label, double elapsed_time) {
-    const char *server_ip = "127.0.0.1"; // Adresse du serveur StatsD
-    const int server_port = 8125;         // Port UDP de StatsD
-    int udp_socket;
-    struct sockaddr_in server_info;
-
-    // Create UDP Socket
-    udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udp_socket < 0) {
-        perror("Erreur lors de l'initialisation du socket UDP");
-        return;
-    }
-    // Configure server IP address
-    memset(&server_info, 0, sizeof(server_info));
-    server_info.sin_family = AF_INET;
-    server_info.sin_port = htons(server_port);
-
-    if (inet_pton(AF_INET, server_ip, &server_info.sin_addr) <= 0) {
-        perror("Erreur lors de la configuration de l'adresse IP du serveur");
-        close(udp_socket);
-        return;
-    }
-
-    // Prepare and format the message to send
-    char data_message[256];
-    snprintf(data_message, sizeof(data_message), "mpi_benchmark:%d|g", (int)(elapsed_time * 1000));
-    // Send the message to the server
-    if (sendto(udp_socket, data_message, strlen(data_message), 0, (struct sockaddr *)&server_info, sizeof(server_info)) < 0) {
-        perror("Erreur lors de l'envoi des données au serveur");
-    }
-
-    // Close the socket
-    close(udp_socket);
-}
+#include "bibw.h"
 
 double calculate_total(double, double, double, int);
 
@@ -61,7 +23,7 @@ int main(int argc, char *argv[])
     char **s_buf, **r_buf;
     double t_start = 0.0, t_end = 0.0, t_lo = 0.0, t_total = 0.0;
     int window_size = 64;
-    int po_ret = 0;
+    int po_ret = 0, bibw_po_ret = 0;
     int errors = 0;
     double tmp_total = 0.0;
     omb_graph_options_t omb_graph_options;
@@ -80,11 +42,27 @@ int main(int argc, char *argv[])
     struct omb_buffer_sizes_t omb_buffer_sizes;
     double *omb_lat_arr = NULL;
     struct omb_stat_t omb_stat;
+    struct bibw_hist_t *window_hist = NULL;
+    struct bibw_stats_t window_stats = {0};
+    struct bibw_result_t result;
+    struct bibw_phases_t phases;
+    char metric_tags[BIBW_METRIC_TAGS_LEN];
+    struct bibw_window_t engine_win;
+    struct bibw_arena_t arena = {NULL, 0, 0, 0, 0};
+    double engine_time[BIBW_MAX_ENGINES];
+    char *placed = NULL;
+    struct bibw_validator_t validator = {0, 0, 0, 0.0, 0.0, NULL};
+    int nbufs = 1;
+    int e = 0;
 
     set_header(HEADER);
     set_benchmark_name("osu_bibw");
 
+    bibw_po_ret = bibw_process_options(&argc, argv);
     po_ret = process_options(argc, argv);
+    if (PO_OKAY == po_ret) {
+        po_ret = bibw_po_ret;
+    }
     omb_populate_mpi_type_list(mpi_type_list);
     if (PO_OKAY == po_ret && NONE != options.accel) {
         if (init_accel()) {
@@ -105,13 +83,19 @@ int main(int argc, char *argv[])
         OMB_CHECK_NULL_AND_EXIT(omb_lat_arr, "Unable to allocate memory");
     }
 
-    omb_init_h = omb_mpi_init(&argc, &argv);
+    window_hist = malloc(sizeof(struct bibw_hist_t));
+    OMB_CHECK_NULL_AND_EXIT(window_hist, "Unable to allocate memory");
+
+    omb_init_h = bibw_mpi_init(&argc, &argv);
     omb_comm = omb_init_h.omb_comm;
     if (MPI_COMM_NULL == omb_comm) {
         OMB_ERROR_EXIT("Cant create communicator");
     }
     MPI_CHECK(MPI_Comm_rank(omb_comm, &myid));
     MPI_CHECK(MPI_Comm_size(omb_comm, &numprocs));
+    if (bibw_options.phases) {
+        bibw_clock_init();
+    }
 
     omb_graph_options_init(&omb_graph_options);
     if (0 == myid) {
@@ -129,6 +113,7 @@ int main(int argc, char *argv[])
                 break;
             case PO_HELP_MESSAGE:
                 print_help_message(myid);
+                bibw_print_help_message(myid);
                 break;
             case PO_VERSION_MESSAGE:
                 print_version_message(myid);
@@ -153,7 +138,8 @@ int main(int argc, char *argv[])
             break;
     }
 
-    if (numprocs != 2) {
+    if (numprocs != 2 &&
+        (NULL == bibw_options.mode || !bibw_options.mode->any_procs)) {
         if (myid == 0) {
             fprintf(stderr, "This test requires exactly two processes\n");
         }
@@ -162,6 +148,38 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    /* Before the telemetry thread starts and any buffer is touched */
+    errors = bibw_placement_apply(myid) ? 1 : 0;
+    MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_MAX,
+                            omb_comm));
+    if (errors) {
+        omb_mpi_finalize(omb_init_h);
+        exit(EXIT_FAILURE);
+    }
+
+    if (0 == myid && bibw_options.statsd) {
+        bibw_telemetry_init(bibw_options.statsd_host, bibw_options.statsd_port,
+                            bibw_options.statsd_mtu);
+    }
+    if (bibw_output_open(omb_comm, myid, numprocs)) {
+        omb_mpi_finalize(omb_init_h);
+        exit(EXIT_FAILURE);
+    }
+
+    if (NULL != bibw_options.mode) {
+        print_preamble(myid);
+        bibw_placement_report(omb_comm, myid, numprocs, NULL);
+        errors = bibw_options.mode->run(omb_comm, myid, numprocs);
+        bibw_output_close();
+        bibw_telemetry_finalize();
+        free(s_buf);
+        free(r_buf);
+        free(omb_lat_arr);
+        free(window_hist);
+        omb_mpi_finalize(omb_init_h);
+        return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
 #ifdef _ENABLE_CUDA_
     if (options.src == 'M' || options.dst == 'M') {
         if (options.buf_num == SINGLE) {
@@ -180,7 +198,44 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (bibw_arena_active()) {
+        if (bibw_arena_init(&arena, options.max_message_size, window_size,
+                            myid)) {
+            /* Error allocating memory */
+            omb_mpi_finalize(omb_init_h);
+            exit(EXIT_FAILURE);
+        }
+        bibw_arena_carve(&arena, s_buf, r_buf);
+        bibw_arena_warm(&arena, omb_comm, 1 - myid);
+    }
+
+    if (bibw_window_borrow(&engine_win, omb_comm, myid, 1 - myid, window_size,
+                           s_buf, r_buf)) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+
+    nbufs = options.buf_num == MULTIPLE ? window_size : 1;
+    if (options.validate && bibw_validate_fast() &&
+        bibw_validate_init(&validator, nbufs)) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+
     print_preamble(myid);
+    if (0 == myid && options.validate && !bibw_validate_fast() &&
+        BIBW_VALIDATOR_OMB != bibw_options.validator) {
+        fprintf(stdout, "# --validator needs contiguous host buffers, "
+                        "using the OMB validation\n");
+    }
+    /* Per-size MULTIPLE buffers do not exist yet */
+    placed = NONE == options.accel &&
+                     (options.buf_num == SINGLE || NULL != arena.base)
+                 ? s_buf[0]
+                 : NULL;
+    if (NULL != placed) {
+        /* Place the first page under the memory policy before locating it */
+        set_buffer_pt2pt(placed, myid, options.accel, 'a', 1);
+    }
+    bibw_placement_report(omb_comm, myid, numprocs, placed);
     omb_papi_init(&papi_eventset);
 
     /* Bi-Directional Bandwidth test */
@@ -195,6 +250,18 @@ int main(int argc, char *argv[])
         }
         fflush(stdout);
         print_only_header(myid);
+        if (0 == myid && bibw_options.num_engines > 0) {
+            fprintf(stdout, "# Trailing columns:");
+            for (e = 0; e < bibw_options.num_engines; e++) {
+                fprintf(stdout, " %s (MB/s)", bibw_options.engines[e]->name);
+            }
+            fprintf(stdout, "\n");
+            fflush(stdout);
+        }
+        if (0 == myid && bibw_options.phases) {
+            fprintf(stdout, "# Phase timers: %s\n", bibw_clock_name());
+            fflush(stdout);
+        }
         for (size = options.min_message_size; size <= options.max_message_size;
              size *= 2) {
             num_elements = size / mpi_type_size;
@@ -206,7 +273,9 @@ int main(int argc, char *argv[])
                                num_elements) *
                 mpi_type_size;
             num_elements = omb_ddt_get_size(num_elements);
-            if (options.buf_num == MULTIPLE) {
+            if (NULL != arena.base) {
+                /* Carved once and pre-faulted in bibw_arena_init() */
+            } else if (options.buf_num == MULTIPLE) {
                 for (i = 0; i < window_size; i++) {
                     if (allocate_memory_pt2pt_size(&s_buf[i], &r_buf[i], myid,
                                                    size)) {
@@ -242,12 +311,21 @@ int main(int argc, char *argv[])
                 &omb_graph_data, &omb_graph_options, size, options.iterations);
             MPI_CHECK(MPI_Barrier(omb_comm));
             t_total = 0.0;
+            bibw_hist_reset(window_hist);
+            bibw_stats_reset(&window_stats);
+            bibw_phases_reset(&phases);
+            bibw_validate_reset(&validator);
 
             for (i = 0; i < options.iterations + options.skip; i++) {
                 if (i == options.skip) {
                     omb_papi_start(&papi_eventset);
                 }
-                if (options.validate) {
+                if (options.validate && bibw_validate_fast()) {
+                    /* Only the windows that get checked are filled */
+                    if (bibw_validate_due(i, options.skip)) {
+                        bibw_validate_fill(&validator, s_buf, nbufs, size, i);
+                    }
+                } else if (options.validate) {
                     if (options.buf_num == MULTIPLE) {
                         for (l = 0; l < window_size; l++) {
                             set_buffer_validation(
@@ -275,6 +353,9 @@ int main(int argc, char *argv[])
                         }
 #endif /* #ifdef _ENABLE_CUDA_KERNEL_ */
 
+                        bibw_phase_begin(&phases,
+                                         i >= (int)options.skip &&
+                                             k == options.warmup_validation);
                         for (j = 0; j < window_size; j++) {
                             if (options.buf_num == SINGLE) {
                                 MPI_CHECK(MPI_Irecv(
@@ -286,6 +367,7 @@ int main(int argc, char *argv[])
                                     1, 10, omb_comm, recv_request + j));
                             }
                         }
+                        bibw_phase_end(&phases, BIBW_PHASE_POST_RECV);
 
                         for (j = 0; j < window_size; j++) {
                             if (options.buf_num == SINGLE) {
@@ -298,12 +380,15 @@ int main(int argc, char *argv[])
                                     1, 100, omb_comm, send_request + j));
                             }
                         }
+                        bibw_phase_end(&phases, BIBW_PHASE_POST_SEND);
 
                         MPI_CHECK(
                             MPI_Waitall(window_size, send_request, reqstat));
+                        bibw_phase_end(&phases, BIBW_PHASE_WAIT_SEND);
 
                         MPI_CHECK(
                             MPI_Waitall(window_size, recv_request, reqstat));
+                        bibw_phase_end(&phases, BIBW_PHASE_WAIT_RECV);
 
 #ifdef _ENABLE_CUDA_KERNEL_
                         if (options.src == 'M') {
@@ -317,8 +402,9 @@ int main(int argc, char *argv[])
                             t_end = MPI_Wtime();
                             t_total += calculate_total(t_start, t_end, t_lo,
                                                        window_size);
-			    // Send t_total to statsd
-                            chrono("MPI_Bidirectional_Bandwidth_Test", t_total);
+                            bibw_hist_record(window_hist,
+                                             calculate_total(t_start, t_end,
+                                                             t_lo, window_size));
 
                             if (options.omb_enable_ddt) {
                                 tmp_total = omb_ddt_transmit_size / 1e6 *
@@ -326,6 +412,10 @@ int main(int argc, char *argv[])
                             } else {
                                 tmp_total = size / 1e6 * window_size * 2;
                             }
+                            bibw_stats_add(&window_stats,
+                                           tmp_total / calculate_total(
+                                                           t_start, t_end,
+                                                           t_lo, window_size));
                             if (options.omb_tail_lat) {
                                 omb_lat_arr[i - options.skip] =
                                     tmp_total / calculate_total(t_start, t_end,
@@ -370,6 +460,9 @@ int main(int argc, char *argv[])
                         }
 #endif /* #ifdef _ENABLE_CUDA_KERNEL_ */
 
+                        bibw_phase_begin(&phases,
+                                         i >= (int)options.skip &&
+                                             k == options.warmup_validation);
                         for (j = 0; j < window_size; j++) {
                             if (options.buf_num == SINGLE) {
                                 MPI_CHECK(MPI_Irecv(
@@ -381,6 +474,7 @@ int main(int argc, char *argv[])
                                     0, 100, omb_comm, recv_request + j));
                             }
                         }
+                        bibw_phase_end(&phases, BIBW_PHASE_POST_RECV);
 
                         for (j = 0; j < window_size; j++) {
                             if (options.buf_num == SINGLE) {
@@ -393,9 +487,11 @@ int main(int argc, char *argv[])
                                     0, 10, omb_comm, send_request + j));
                             }
                         }
+                        bibw_phase_end(&phases, BIBW_PHASE_POST_SEND);
 
                         MPI_CHECK(
                             MPI_Waitall(window_size, recv_request, reqstat));
+                        bibw_phase_end(&phases, BIBW_PHASE_WAIT_RECV);
 
 #ifdef _ENABLE_CUDA_KERNEL_
                         if (options.dst == 'M') {
@@ -406,6 +502,7 @@ int main(int argc, char *argv[])
 
                         MPI_CHECK(
                             MPI_Waitall(window_size, send_request, reqstat));
+                        bibw_phase_end(&phases, BIBW_PHASE_WAIT_SEND);
 #ifdef _ENABLE_CUDA_KERNEL_
                         if (options.validate &&
                             !(options.src == 'M' && options.MMsrc == 'D' &&
@@ -432,7 +529,13 @@ int main(int argc, char *argv[])
                     }
                 }
                 if (i >= options.skip && options.validate) {
-                    if (options.buf_num == SINGLE) {
+                    if (bibw_validate_fast()) {
+                        if (bibw_validate_due(i, options.skip)) {
+                            errors += bibw_validate_check(
+                                &validator, omb_comm, 1 - myid, r_buf, nbufs,
+                                size, i);
+                        }
+                    } else if (options.buf_num == SINGLE) {
                         errors +=
                             validate_data(r_buf[0], size, 1, options.accel, i,
                                           omb_curr_datatype);
@@ -450,6 +553,21 @@ int main(int argc, char *argv[])
             }
             omb_papi_stop_and_print(&papi_eventset, size);
 
+            /* Same buffers and schedule through each extra engine */
+            if (0 == errors && bibw_options.num_engines > 0) {
+                if (bibw_window_set_type(&engine_win, size, num_elements,
+                                         omb_curr_datatype)) {
+                    OMB_ERROR_EXIT("Unable to prepare window engine");
+                }
+                for (e = 0; e < bibw_options.num_engines; e++) {
+                    bibw_window_set_engine(&engine_win,
+                                           bibw_options.engines[e]);
+                    engine_time[e] = bibw_window_run(
+                        &engine_win, options.iterations, options.skip);
+                }
+                bibw_window_set_engine(&engine_win, &bibw_engine_isend);
+            }
+
             if (myid == 0) {
                 if (options.omb_enable_ddt) {
                     tmp_total = omb_ddt_transmit_size / 1e6 *
@@ -474,15 +592,56 @@ int main(int argc, char *argv[])
                 if (options.omb_enable_ddt) {
                     fprintf(stdout, "%*zu", FIELD_WIDTH, omb_ddt_transmit_size);
                 }
+                for (e = 0; e < bibw_options.num_engines; e++) {
+                    fprintf(stdout, "%*.*f", FIELD_WIDTH, FLOAT_PRECISION,
+                            tmp_total / engine_time[e]);
+                }
                 fprintf(stdout, "\n");
                 fflush(stdout);
                 if (options.graph && 0 == myid) {
                     omb_graph_data->avg = tmp_total / t_total;
                 }
+                snprintf(metric_tags, sizeof(metric_tags),
+                         "size:%d,datatype:%.32s,window:%d,engine:isend", size,
+                         mpi_type_name_str, window_size);
+                bibw_hist_emit(window_hist, "mpi_benchmark.window",
+                               metric_tags);
+                bibw_telemetry_emit("mpi_benchmark.bandwidth",
+                                    tmp_total * 1e6 / t_total, "h",
+                                    metric_tags);
+                for (e = 0; e < bibw_options.num_engines; e++) {
+                    snprintf(metric_tags, sizeof(metric_tags),
+                             "size:%d,datatype:%.32s,window:%d,engine:%s",
+                             size, mpi_type_name_str, window_size,
+                             bibw_options.engines[e]->name);
+                    bibw_telemetry_emit("mpi_benchmark.bandwidth",
+                                        tmp_total * 1e6 / engine_time[e], "h",
+                                        metric_tags);
+                }
+
+                result.size = size;
+                result.datatype = mpi_type_name_str;
+                result.engine = bibw_engine_isend.name;
+                result.window = window_size;
+                result.iterations = options.iterations;
+                result.bandwidth = tmp_total / t_total;
+                result.windows = &window_stats;
+                bibw_output_result(&result);
+                result.windows = NULL;
+                for (e = 0; e < bibw_options.num_engines; e++) {
+                    result.engine = bibw_options.engines[e]->name;
+                    result.bandwidth = tmp_total / engine_time[e];
+                    bibw_output_result(&result);
+                }
+            }
+            if (0 == myid && options.validate && bibw_validate_fast()) {
+                bibw_validate_report(&validator, options.iterations);
+                fflush(stdout);
             }
+            bibw_phases_report(&phases, omb_comm, myid, numprocs, size);
 
             omb_ddt_free(&omb_curr_datatype);
-            if (options.buf_num == MULTIPLE) {
+            if (options.buf_num == MULTIPLE && NULL == arena.base) {
                 for (i = 0; i < window_size; i++) {
                     free_memory(s_buf[i], r_buf[i], myid);
                 }
@@ -509,6 +668,13 @@ int main(int argc, char *argv[])
     free(s_buf);
     free(r_buf);
     free(omb_lat_arr);
+    free(window_hist);
+    bibw_stats_free(&window_stats);
+    bibw_validate_free(&validator);
+    bibw_window_free(&engine_win);
+    bibw_arena_free(&arena);
+    bibw_output_close();
+    bibw_telemetry_finalize();
     omb_mpi_finalize(omb_init_h);
 
     if (NONE != options.accel) {
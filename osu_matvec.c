@@ -0,0 +1,431 @@
+#define BENCHMARK "MPI Matrix action on a vector"
+/*
+ * Distributed dense matrix-vector product, the C counterpart of the mpi4py
+ * matvec run in results_python.txt.
+ *
+ * The N x N matrix is distributed in row blocks; every iteration computes
+ * y = A x and feeds y back as the next x. The vector travels either with
+ * one MPI_Allgatherv per iteration (-c allgather, default) or around a
+ * ring (-c ring): in each of the p steps a rank multiplies its rows with
+ * the x block it holds while passing that block on to the next rank, so
+ * the exchange overlaps the kernel. The local kernel works on column
+ * tiles that keep the x chunk in L1 and four rows at a time, with GCC/Clang
+ * vector extensions for the SIMD part.
+ *
+ * For every process count (1, 2, 4, ... up to -np, see -p) and order (-n)
+ * it prints the Python run's "Duration [s]  Throughput [#/s]" rows, one
+ * per repetition, followed by GFLOP/s and the share of time spent in
+ * communication.
+ *
+ * A = v v^T / (v . v) with v_j = 1 + j / N, and x starts at v, so A x = v
+ * and every x stays v. Since v is strictly increasing, any x block in the
+ * wrong place or column block multiplied with the wrong part of x lowers
+ * the sums (rearrangement inequality), and the check after the last
+ * repetition catches it.
+ */
+#include <osu_util_mpi.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MATVEC_MAX_LIST 32
+#define COL_TILE 1024 /* doubles of x per tile: 8 KiB stays in L1 */
+#define DURATION_WIDTH 14 /* first column, fits "# Duration [s]" */
+
+typedef double v4d __attribute__((vector_size(32), aligned(8)));
+
+enum { EXCHANGE_ALLGATHER, EXCHANGE_RING };
+
+static struct {
+    int orders[MATVEC_MAX_LIST];
+    int norders;
+    int procs[MATVEC_MAX_LIST];
+    int nprocs;
+    int iterations;
+    int repeats;
+    int exchange;
+} matvec_options = {{1000, 2500, 5000, 10000}, 4, {0}, 0, 20, 10,
+                    EXCHANGE_ALLGATHER};
+
+struct matvec_t {
+    MPI_Comm comm;
+    int rank, p, n;
+    int *counts, *displs;             /* rows (and x entries) per rank */
+    int rows;
+    double *a;                        /* rows x n, row major */
+    double *x;                        /* full vector, n */
+    double *y;                        /* local result, rows */
+    double *ring[2];                  /* x blocks travelling the ring */
+    double t_comm;
+};
+
+static int parse_list(const char *arg, int *list, int *n)
+{
+    char buf[256], *tok = NULL, *save = NULL, *end = NULL;
+
+    if (strlen(arg) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, arg);
+    *n = 0;
+    for (tok = strtok_r(buf, ",", &save); NULL != tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (MATVEC_MAX_LIST == *n) {
+            return -1;
+        }
+        list[*n] = (int)strtol(tok, &end, 10);
+        if (end == tok || '\0' != *end || list[*n] <= 0) {
+            return -1;
+        }
+        (*n)++;
+    }
+    return *n > 0 ? 0 : -1;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stdout,
+            "Usage: %s [options]\n"
+            "  -n LIST   matrix orders, comma separated "
+            "(default 1000,2500,5000,10000)\n"
+            "  -p LIST   process counts (default 1, 2, 4, ... up to -np)\n"
+            "  -i N      iterations per repetition (default 20)\n"
+            "  -r N      repetitions per configuration (default 10)\n"
+            "  -c MODE   vector exchange: allgather or ring "
+            "(default allgather)\n"
+            "  -h        this help\n",
+            prog);
+}
+
+static int process_matvec_options(int argc, char *argv[])
+{
+    int c = 0;
+
+    while (-1 != (c = getopt(argc, argv, "n:p:i:r:c:h"))) {
+        switch (c) {
+            case 'n':
+                if (parse_list(optarg, matvec_options.orders,
+                               &matvec_options.norders)) {
+                    return PO_BAD_USAGE;
+                }
+                break;
+            case 'p':
+                if (parse_list(optarg, matvec_options.procs,
+                               &matvec_options.nprocs)) {
+                    return PO_BAD_USAGE;
+                }
+                break;
+            case 'i':
+                matvec_options.iterations = atoi(optarg);
+                if (matvec_options.iterations <= 0) {
+                    return PO_BAD_USAGE;
+                }
+                break;
+            case 'r':
+                matvec_options.repeats = atoi(optarg);
+                if (matvec_options.repeats <= 0) {
+                    return PO_BAD_USAGE;
+                }
+                break;
+            case 'c':
+                if (0 == strcmp(optarg, "allgather")) {
+                    matvec_options.exchange = EXCHANGE_ALLGATHER;
+                } else if (0 == strcmp(optarg, "ring")) {
+                    matvec_options.exchange = EXCHANGE_RING;
+                } else {
+                    return PO_BAD_USAGE;
+                }
+                break;
+            case 'h':
+                return PO_HELP_MESSAGE;
+            default:
+                return PO_BAD_USAGE;
+        }
+    }
+    return PO_OKAY;
+}
+
+/*
+ * y[0..rows) += A[:, c0..c1) x, where x holds the entries c0..c1 from
+ * x[0] on. Column tiles keep the x chunk in L1 across all rows; four rows
+ * share every x load.
+ */
+static void kernel(const double *a, size_t lda, int rows, const double *x,
+                   int c0, int c1, double *y)
+{
+    int jb = 0, je = 0, r = 0, j = 0, k = 0;
+
+    for (jb = c0; jb < c1; jb += COL_TILE) {
+        je = jb + COL_TILE < c1 ? jb + COL_TILE : c1;
+        for (r = 0; r + 4 <= rows; r += 4) {
+            const double *row[4] = {a + r * lda, a + (r + 1) * lda,
+                                    a + (r + 2) * lda, a + (r + 3) * lda};
+            v4d acc[4] = {{0}, {0}, {0}, {0}};
+            double tail[4] = {0.0, 0.0, 0.0, 0.0};
+
+            for (j = jb; j + 4 <= je; j += 4) {
+                v4d xv = *(const v4d *)(x + j - c0);
+
+                for (k = 0; k < 4; k++) {
+                    acc[k] += *(const v4d *)(row[k] + j) * xv;
+                }
+            }
+            for (; j < je; j++) {
+                for (k = 0; k < 4; k++) {
+                    tail[k] += row[k][j] * x[j - c0];
+                }
+            }
+            for (k = 0; k < 4; k++) {
+                y[r + k] +=
+                    acc[k][0] + acc[k][1] + acc[k][2] + acc[k][3] + tail[k];
+            }
+        }
+        for (; r < rows; r++) {
+            double sum = 0.0;
+
+            for (j = jb; j < je; j++) {
+                sum += a[r * lda + j] * x[j - c0];
+            }
+            y[r] += sum;
+        }
+    }
+}
+
+/* Entry j of the fixed point v of A */
+static double fixed_point(int j, int n)
+{
+    return 1.0 + (double)j / n;
+}
+
+static int matvec_init(struct matvec_t *m, MPI_Comm comm, int n)
+{
+    double vv = 0.0, vi = 0.0;
+    int r = 0, max_rows = 0, j = 0;
+
+    memset(m, 0, sizeof(*m));
+    m->comm = comm;
+    m->n = n;
+    MPI_CHECK(MPI_Comm_rank(comm, &m->rank));
+    MPI_CHECK(MPI_Comm_size(comm, &m->p));
+    m->counts = malloc(sizeof(int) * m->p);
+    m->displs = malloc(sizeof(int) * m->p);
+    if (NULL == m->counts || NULL == m->displs) {
+        return -1;
+    }
+    for (r = 0; r < m->p; r++) {
+        m->counts[r] = n / m->p + (r < n % m->p);
+        m->displs[r] = r ? m->displs[r - 1] + m->counts[r - 1] : 0;
+        max_rows = m->counts[r] > max_rows ? m->counts[r] : max_rows;
+    }
+    m->rows = m->counts[m->rank];
+
+    m->a = malloc(sizeof(double) * (size_t)m->rows * n);
+    m->x = malloc(sizeof(double) * n);
+    m->y = malloc(sizeof(double) * (m->rows ? m->rows : 1));
+    m->ring[0] = malloc(sizeof(double) * max_rows);
+    m->ring[1] = malloc(sizeof(double) * max_rows);
+    if (NULL == m->a || NULL == m->x || NULL == m->y || NULL == m->ring[0] ||
+        NULL == m->ring[1]) {
+        return -1;
+    }
+    for (j = 0; j < n; j++) {
+        m->x[j] = fixed_point(j, n);
+        vv += m->x[j] * m->x[j];
+    }
+    /* First touch by the owning rank */
+    for (r = 0; r < m->rows; r++) {
+        vi = fixed_point(m->displs[m->rank] + r, n) / vv;
+        for (j = 0; j < n; j++) {
+            m->a[(size_t)r * n + j] = vi * m->x[j];
+        }
+    }
+
+    return 0;
+}
+
+static void matvec_free(struct matvec_t *m)
+{
+    free(m->counts);
+    free(m->displs);
+    free(m->a);
+    free(m->x);
+    free(m->y);
+    free(m->ring[0]);
+    free(m->ring[1]);
+    memset(m, 0, sizeof(*m));
+}
+
+static void iterate_allgather(struct matvec_t *m)
+{
+    double t = MPI_Wtime();
+
+    MPI_CHECK(MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, m->x,
+                             m->counts, m->displs, MPI_DOUBLE, m->comm));
+    m->t_comm += MPI_Wtime() - t;
+    memset(m->y, 0, sizeof(double) * m->rows);
+    kernel(m->a, m->n, m->rows, m->x, 0, m->n, m->y);
+    memcpy(m->x + m->displs[m->rank], m->y, sizeof(double) * m->rows);
+}
+
+/*
+ * Step s multiplies with the block that started on rank - s while that
+ * block moves on to rank + 1 and the one from rank - 1 arrives.
+ */
+static void iterate_ring(struct matvec_t *m)
+{
+    MPI_Request req[2];
+    int right = (m->rank + 1) % m->p, left = (m->rank + m->p - 1) % m->p;
+    int s = 0, owner = 0, next = 0, cur = 0;
+    double t = 0.0;
+
+    memcpy(m->ring[0], m->x + m->displs[m->rank],
+           sizeof(double) * m->rows);
+    memset(m->y, 0, sizeof(double) * m->rows);
+    for (s = 0; s < m->p; s++) {
+        owner = (m->rank - s + m->p) % m->p;
+        next = (owner + m->p - 1) % m->p;
+        t = MPI_Wtime();
+        if (s + 1 < m->p) {
+            MPI_CHECK(MPI_Irecv(m->ring[1 - cur], m->counts[next], MPI_DOUBLE,
+                                left, 0, m->comm, &req[0]));
+            MPI_CHECK(MPI_Isend(m->ring[cur], m->counts[owner], MPI_DOUBLE,
+                                right, 0, m->comm, &req[1]));
+        }
+        m->t_comm += MPI_Wtime() - t;
+        kernel(m->a, m->n, m->rows, m->ring[cur], m->displs[owner],
+               m->displs[owner] + m->counts[owner], m->y);
+        if (s + 1 < m->p) {
+            t = MPI_Wtime();
+            MPI_CHECK(MPI_Waitall(2, req, MPI_STATUSES_IGNORE));
+            m->t_comm += MPI_Wtime() - t;
+            cur = 1 - cur;
+        }
+    }
+    memcpy(m->x + m->displs[m->rank], m->y, sizeof(double) * m->rows);
+}
+
+static int check(const struct matvec_t *m)
+{
+    double want = 0.0;
+    int r = 0, errors = 0;
+
+    for (r = 0; r < m->rows; r++) {
+        want = fixed_point(m->displs[m->rank] + r, m->n);
+        /* Written so that NaN, e.g. from reading past A, counts too */
+        errors += !(fabs(m->y[r] - want) <= 1e-9 * want);
+    }
+    MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_SUM,
+                            m->comm));
+    return errors;
+}
+
+/* Run all repetitions of one (process count, order); returns errors */
+static int run(MPI_Comm comm, int n)
+{
+    struct matvec_t m;
+    double t_start = 0.0, t[2] = {0.0, 0.0}, flops = 0.0;
+    int rep = 0, it = 0, errors = 0;
+
+    if (matvec_init(&m, comm, n)) {
+        OMB_ERROR_EXIT("Unable to allocate memory");
+    }
+    if (0 == m.rank) {
+        fprintf(stdout, "# %s, %d iterations of size %d, %d processes, %s\n",
+                BENCHMARK, matvec_options.iterations, n, m.p,
+                EXCHANGE_RING == matvec_options.exchange ? "ring"
+                                                         : "allgather");
+        fprintf(stdout, "%-*s%*s%*s%*s\n", DURATION_WIDTH, "# Duration [s]",
+                FIELD_WIDTH, "Throughput [#/s]", FIELD_WIDTH, "GFLOP/s",
+                FIELD_WIDTH, "Comm (%)");
+        fflush(stdout);
+    }
+    flops = 2.0 * n * n * matvec_options.iterations;
+
+    for (rep = 0; rep < matvec_options.repeats; rep++) {
+        m.t_comm = 0.0;
+        MPI_CHECK(MPI_Barrier(comm));
+        t_start = MPI_Wtime();
+        for (it = 0; it < matvec_options.iterations; it++) {
+            if (EXCHANGE_RING == matvec_options.exchange) {
+                iterate_ring(&m);
+            } else {
+                iterate_allgather(&m);
+            }
+        }
+        /* Slowest rank's duration, mean communication share */
+        t[0] = MPI_Wtime() - t_start;
+        t[1] = m.t_comm;
+        MPI_CHECK(MPI_Reduce(0 == m.rank ? MPI_IN_PLACE : t, t, 1, MPI_DOUBLE,
+                             MPI_MAX, 0, comm));
+        MPI_CHECK(MPI_Reduce(0 == m.rank ? MPI_IN_PLACE : t + 1, t + 1, 1,
+                             MPI_DOUBLE, MPI_SUM, 0, comm));
+        if (0 == m.rank) {
+            fprintf(stdout, "%-*.3f%*.*f%*.*f%*.*f\n", DURATION_WIDTH, t[0],
+                    FIELD_WIDTH, FLOAT_PRECISION,
+                    matvec_options.iterations / t[0], FIELD_WIDTH,
+                    FLOAT_PRECISION, flops / t[0] / 1e9, FIELD_WIDTH,
+                    FLOAT_PRECISION, t[1] / m.p / t[0] * 100.0);
+            fflush(stdout);
+        }
+    }
+
+    errors = check(&m);
+    if (0 == m.rank && errors) {
+        fprintf(stderr, "MATVEC VALIDATION ERROR: %d wrong entries for "
+                        "size %d on %d processes\n",
+                errors, n, m.p);
+    }
+    matvec_free(&m);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    MPI_Comm comm = MPI_COMM_NULL;
+    int rank = 0, numprocs = 0, po_ret = 0, errors = 0, i = 0, k = 0;
+
+    po_ret = process_matvec_options(argc, argv);
+    MPI_CHECK(MPI_Init(&argc, &argv));
+    MPI_CHECK(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
+    MPI_CHECK(MPI_Comm_size(MPI_COMM_WORLD, &numprocs));
+    if (PO_OKAY != po_ret) {
+        if (0 == rank) {
+            print_usage(argv[0]);
+        }
+        MPI_CHECK(MPI_Finalize());
+        return PO_HELP_MESSAGE == po_ret ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (0 == matvec_options.nprocs) {
+        for (k = 1; k < numprocs; k *= 2) {
+            matvec_options.procs[matvec_options.nprocs++] = k;
+        }
+        matvec_options.procs[matvec_options.nprocs++] = numprocs;
+    }
+
+    for (i = 0; i < matvec_options.nprocs; i++) {
+        if (matvec_options.procs[i] > numprocs) {
+            continue;
+        }
+        MPI_CHECK(MPI_Comm_split(MPI_COMM_WORLD,
+                                 rank < matvec_options.procs[i] ? 0
+                                                                : MPI_UNDEFINED,
+                                 rank, &comm));
+        for (k = 0; k < matvec_options.norders; k++) {
+            if (MPI_COMM_NULL != comm) {
+                errors += run(comm, matvec_options.orders[k]);
+            }
+        }
+        if (MPI_COMM_NULL != comm) {
+            MPI_CHECK(MPI_Comm_free(&comm));
+        }
+        /* Idle ranks wait here so runs never share the machine */
+        MPI_CHECK(MPI_Barrier(MPI_COMM_WORLD));
+    }
+
+    MPI_CHECK(MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_SUM,
+                            MPI_COMM_WORLD));
+    MPI_CHECK(MPI_Finalize());
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}